@@ -0,0 +1,412 @@
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUIET_MS 100
+#define TIMEOUT_MS 30000
+#define STATS_TIMEOUT_MS 2000
+#define DRAG_STEPS 100
+#define DOCK_HEIGHT 30
+
+typedef struct {
+    Window window;
+    int x;
+    int y;
+    Bool mapped;
+} BenchWindow;
+
+typedef struct {
+    long requests;
+    long round_trips;
+    long configures;
+} RudeStats;
+
+static Display *dpy;
+static Window root;
+static Atom stats_atom;
+static BenchWindow *windows = NULL;
+static int nwindows = 0;
+static Window dock = None;
+static int dock_y = 0;
+static double last_event = 0;
+static Bool stats_ready = False;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static BenchWindow *find_window(Window w) {
+    for (int i = 0; i < nwindows; i++)
+        if (windows[i].window == w)
+            return &windows[i];
+    return NULL;
+}
+
+static void handle_event(XEvent *ev) {
+    BenchWindow *bw;
+
+    switch (ev->type) {
+        case ConfigureNotify:
+            if (ev->xconfigure.event != ev->xconfigure.window)
+                break;
+            if ((bw = find_window(ev->xconfigure.window))) {
+                bw->x = ev->xconfigure.x;
+                bw->y = ev->xconfigure.y;
+                last_event = now_ms();
+            }
+            break;
+        case MapNotify:
+            if ((bw = find_window(ev->xmap.window))) {
+                bw->mapped = True;
+                last_event = now_ms();
+            }
+            break;
+        case UnmapNotify:
+            if ((bw = find_window(ev->xunmap.window))) {
+                bw->mapped = False;
+                last_event = now_ms();
+            }
+            break;
+        case PropertyNotify:
+            if (ev->xproperty.atom == stats_atom && ev->xproperty.state == PropertyNewValue)
+                stats_ready = True;
+            break;
+    }
+}
+
+static Bool wait_for(Bool (*done)(void), double start, double timeout) {
+    double deadline = start + timeout;
+    XEvent ev;
+
+    last_event = start;
+    for (;;) {
+        while (XPending(dpy)) {
+            XNextEvent(dpy, &ev);
+            handle_event(&ev);
+        }
+        double now = now_ms();
+        if (done() && now - last_event >= QUIET_MS)
+            return True;
+        if (now >= deadline) {
+            fprintf(stderr, "rude-bench: timed out waiting for rude\n");
+            return False;
+        }
+        struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+        poll(&pfd, 1, QUIET_MS / 4);
+    }
+}
+
+static Bool always() {
+    return True;
+}
+
+static Bool all_tiled() {
+    for (int i = 0; i < nwindows; i++)
+        if (!windows[i].mapped || windows[i].x <= -9000 || windows[i].y < dock_y)
+            return False;
+    return True;
+}
+
+static Bool all_parked() {
+    for (int i = 0; i < nwindows; i++)
+        if (windows[i].x > -9000)
+            return False;
+    return True;
+}
+
+static Bool all_unmapped() {
+    for (int i = 0; i < nwindows; i++)
+        if (windows[i].mapped)
+            return False;
+    return True;
+}
+
+static Bool got_stats() {
+    return stats_ready;
+}
+
+static RudeStats query_stats() {
+    RudeStats stats = { 0, 0, 0 };
+    XEvent ev;
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    long *data = NULL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = ClientMessage;
+    ev.xclient.window = root;
+    ev.xclient.message_type = stats_atom;
+    ev.xclient.format = 32;
+    stats_ready = False;
+    XSendEvent(dpy, root, False, SubstructureRedirectMask | SubstructureNotifyMask, &ev);
+    XFlush(dpy);
+    if (!wait_for(got_stats, now_ms(), STATS_TIMEOUT_MS)) {
+        fprintf(stderr, "rude-bench: rude does not answer _RUDE_STATS, build it with STATS=1\n");
+        exit(1);
+    }
+
+    if (XGetWindowProperty(dpy, root, stats_atom, 0, 3, False, XA_CARDINAL, &actual_type,
+                           &actual_format, &nitems, &bytes_after, (unsigned char **)&data) == Success && data) {
+        if (nitems == 3) {
+            stats.requests = data[0];
+            stats.round_trips = data[1];
+            stats.configures = data[2];
+        }
+        XFree(data);
+    }
+    return stats;
+}
+
+static void report(const char *scenario, int n, int ops, double latency, RudeStats *before, RudeStats *after) {
+    printf("%-12s %5d %6d %12.2f %14.2f %12.2f %19.2f\n", scenario, n, ops, latency,
+           (double)(after->configures - before->configures) / ops,
+           (double)(after->requests - before->requests) / ops,
+           (double)(after->round_trips - before->round_trips) / ops);
+    fflush(stdout);
+}
+
+static long root_cardinal(const char *name, long fallback) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    long *data = NULL;
+    long value = fallback;
+
+    if (XGetWindowProperty(dpy, root, XInternAtom(dpy, name, False), 0, 1, False, XA_CARDINAL,
+                           &actual_type, &actual_format, &nitems, &bytes_after,
+                           (unsigned char **)&data) == Success && data) {
+        if (actual_format == 32 && nitems == 1)
+            value = data[0];
+        XFree(data);
+    }
+    return value;
+}
+
+static void switch_desktop(long desktop) {
+    XEvent ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = ClientMessage;
+    ev.xclient.window = root;
+    ev.xclient.message_type = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = desktop;
+    XSendEvent(dpy, root, False, SubstructureRedirectMask | SubstructureNotifyMask, &ev);
+    XFlush(dpy);
+}
+
+static void press_keys(KeySym mod, KeySym key) {
+    KeyCode modcode = XKeysymToKeycode(dpy, mod);
+    KeyCode keycode = XKeysymToKeycode(dpy, key);
+
+    XTestFakeKeyEvent(dpy, modcode, True, CurrentTime);
+    XTestFakeKeyEvent(dpy, keycode, True, CurrentTime);
+    XTestFakeKeyEvent(dpy, keycode, False, CurrentTime);
+    XTestFakeKeyEvent(dpy, modcode, False, CurrentTime);
+    XFlush(dpy);
+}
+
+static void bench_map(int n) {
+    RudeStats before, after;
+
+    windows = calloc(n, sizeof(BenchWindow));
+    if (windows == NULL) {
+        fprintf(stderr, "rude-bench: failed to allocate memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        windows[i].window = XCreateSimpleWindow(dpy, root, 0, 0, 100, 100, 0, 0, 0);
+        XSelectInput(dpy, windows[i].window, StructureNotifyMask);
+    }
+    nwindows = n;
+
+    before = query_stats();
+    double start = now_ms();
+    for (int i = 0; i < n; i++)
+        XMapWindow(dpy, windows[i].window);
+    XFlush(dpy);
+    wait_for(all_tiled, start, TIMEOUT_MS);
+    double latency = last_event - start;
+    after = query_stats();
+    report("map", n, n, latency, &before, &after);
+}
+
+static void bench_switch(int n) {
+    RudeStats before, after;
+    long desktops = root_cardinal("_NET_NUMBER_OF_DESKTOPS", 2);
+    long home = root_cardinal("_NET_CURRENT_DESKTOP", 0);
+    long away = (home + 1) % (desktops > 1 ? desktops : 2);
+
+    before = query_stats();
+    double start = now_ms();
+    switch_desktop(away);
+    wait_for(all_parked, start, TIMEOUT_MS);
+    double latency = last_event - start;
+    after = query_stats();
+    report("switch-away", n, 1, latency, &before, &after);
+
+    before = query_stats();
+    start = now_ms();
+    switch_desktop(home);
+    wait_for(all_tiled, start, TIMEOUT_MS);
+    latency = last_event - start;
+    after = query_stats();
+    report("switch-back", n, 1, latency, &before, &after);
+}
+
+static void bench_dock(int n) {
+    RudeStats before, after;
+    int width = DisplayWidth(dpy, DefaultScreen(dpy));
+    Atom type = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
+    long strut[12] = { 0, 0, DOCK_HEIGHT, 0, 0, 0, 0, 0, 0, width - 1, 0, 0 };
+
+    dock = XCreateSimpleWindow(dpy, root, 0, 0, width, DOCK_HEIGHT, 0, 0, 0);
+    XChangeProperty(dpy, dock, XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False), XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)&type, 1);
+    XChangeProperty(dpy, dock, XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False), XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)strut, 12);
+
+    before = query_stats();
+    double start = now_ms();
+    dock_y = DOCK_HEIGHT;
+    XMapWindow(dpy, dock);
+    XFlush(dpy);
+    wait_for(all_tiled, start, TIMEOUT_MS);
+    double latency = last_event - start;
+    after = query_stats();
+    report("dock", n, 1, latency, &before, &after);
+
+    before = query_stats();
+    start = now_ms();
+    dock_y = 0;
+    XDestroyWindow(dpy, dock);
+    XFlush(dpy);
+    dock = None;
+    wait_for(always, start, TIMEOUT_MS);
+    latency = last_event - start;
+    after = query_stats();
+    report("undock", n, 1, latency, &before, &after);
+}
+
+static void bench_drag(int n) {
+    RudeStats before, after;
+    BenchWindow *bw = &windows[nwindows - 1];
+
+    press_keys(XK_Super_L, XK_space);
+    wait_for(always, now_ms(), TIMEOUT_MS);
+
+    KeyCode modcode = XKeysymToKeycode(dpy, XK_Super_L);
+    int x = bw->x + 50, y = bw->y + 50;
+
+    before = query_stats();
+    XTestFakeMotionEvent(dpy, -1, x, y, CurrentTime);
+    XTestFakeKeyEvent(dpy, modcode, True, CurrentTime);
+    XTestFakeButtonEvent(dpy, 1, True, CurrentTime);
+    XFlush(dpy);
+    double last_motion = now_ms();
+    for (int i = 1; i <= DRAG_STEPS; i++) {
+        XTestFakeMotionEvent(dpy, -1, x + i * 2, y + i, CurrentTime);
+        XFlush(dpy);
+        usleep(1000);
+        last_motion = now_ms();
+    }
+    XTestFakeButtonEvent(dpy, 1, False, CurrentTime);
+    XTestFakeKeyEvent(dpy, modcode, False, CurrentTime);
+    XFlush(dpy);
+    wait_for(always, last_motion, TIMEOUT_MS);
+    double latency = last_event - last_motion;
+    after = query_stats();
+    report("drag", n, DRAG_STEPS, latency > 0 ? latency : 0, &before, &after);
+
+    press_keys(XK_Super_L, XK_space);
+    wait_for(all_tiled, now_ms(), TIMEOUT_MS);
+}
+
+static void bench_unmap(int n) {
+    RudeStats before, after;
+
+    before = query_stats();
+    double start = now_ms();
+    for (int i = 0; i < nwindows; i++)
+        XUnmapWindow(dpy, windows[i].window);
+    XFlush(dpy);
+    wait_for(all_unmapped, start, TIMEOUT_MS);
+    double latency = last_event - start;
+    after = query_stats();
+    report("unmap", n, n, latency, &before, &after);
+
+    for (int i = 0; i < nwindows; i++)
+        XDestroyWindow(dpy, windows[i].window);
+    XSync(dpy, False);
+    free(windows);
+    windows = NULL;
+    nwindows = 0;
+}
+
+static void wait_for_wm() {
+    Atom check = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
+    double deadline = now_ms() + TIMEOUT_MS;
+
+    while (now_ms() < deadline) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *data = NULL;
+
+        if (XGetWindowProperty(dpy, root, check, 0, 1, False, XA_WINDOW, &actual_type, &actual_format,
+                               &nitems, &bytes_after, &data) == Success && data) {
+            XFree(data);
+            if (nitems == 1)
+                return;
+        }
+        usleep(10000);
+    }
+    fprintf(stderr, "rude-bench: rude is not running\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int default_sizes[] = { 1, 10, 100, 500 };
+    int event_base, error_base, major, minor;
+
+    for (int i = 0; i < TIMEOUT_MS / 10 && !(dpy = XOpenDisplay(NULL)); i++)
+        usleep(10000);
+    if (!dpy) {
+        fprintf(stderr, "rude-bench: cannot open display\n");
+        exit(1);
+    }
+    if (!XTestQueryExtension(dpy, &event_base, &error_base, &major, &minor)) {
+        fprintf(stderr, "rude-bench: XTEST extension missing\n");
+        exit(1);
+    }
+    root = DefaultRootWindow(dpy);
+    stats_atom = XInternAtom(dpy, "_RUDE_STATS", False);
+    XSelectInput(dpy, root, PropertyChangeMask);
+    wait_for_wm();
+
+    printf("%-12s %5s %6s %12s %14s %12s %19s\n", "scenario", "n", "ops", "latency_ms",
+           "configures/op", "requests/op", "main_round_trips/op");
+    int count = argc > 1 ? argc - 1 : (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    for (int i = 0; i < count; i++) {
+        int n = argc > 1 ? atoi(argv[i + 1]) : default_sizes[i];
+        if (n <= 0)
+            continue;
+        bench_map(n);
+        bench_switch(n);
+        bench_dock(n);
+        bench_drag(n);
+        bench_unmap(n);
+    }
+    XCloseDisplay(dpy);
+    return 0;
+}
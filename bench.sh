@@ -0,0 +1,24 @@
+#!/bin/sh
+set -e
+
+display=${BENCH_DISPLAY:-:99}
+screen=${BENCH_SCREEN:-1920x1080x24}
+
+Xvfb "$display" -screen 0 "$screen" -nolisten tcp >/dev/null 2>&1 &
+xvfb=$!
+trap 'kill $rude $xvfb 2>/dev/null || true' EXIT INT TERM
+
+socket=/tmp/.X11-unix/X${display#:}
+i=0
+while [ ! -e "$socket" ]; do
+    i=$((i + 1))
+    if [ $i -gt 500 ] || ! kill -0 $xvfb 2>/dev/null; then
+        echo "bench: Xvfb did not start on $display" >&2
+        exit 1
+    fi
+    sleep 0.01
+done
+
+DISPLAY=$display ./rude &
+rude=$!
+DISPLAY=$display ./rude-bench "$@"
@@ -0,0 +1,92 @@
+#include "layout.h"
+
+const Layout layouts[LAYOUT_LAST] = {
+    [LAYOUT_TILE] = { "tile", layout_tile },
+    [LAYOUT_GRID] = { "grid", layout_grid },
+    [LAYOUT_MONOCLE] = { "monocle", layout_monocle },
+    [LAYOUT_SCROLL] = { "scroll", layout_scroll },
+};
+
+static WindowGeometry cell(int x, int y, int width, int height, int gap) {
+    WindowGeometry g = { x + gap, y + gap, width - gap * 2 - 2, height - gap * 2 - 2 };
+    if (g.width < LAYOUT_MIN_SIZE)
+        g.width = LAYOUT_MIN_SIZE;
+    if (g.height < LAYOUT_MIN_SIZE)
+        g.height = LAYOUT_MIN_SIZE;
+    return g;
+}
+
+static void column(WindowGeometry area, int n, int gap, WindowGeometry *out) {
+    int height = (area.height - gap * 2 - gap * (n - 1)) / n;
+    int step = height + gap;
+
+    if (height < LAYOUT_MIN_SIZE) {
+        height = LAYOUT_MIN_SIZE;
+        step = n > 1 ? (area.height - gap * 2 - height) / (n - 1) : 0;
+        if (step < 0)
+            step = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = cell(area.x, area.y + i * step, area.width, height + gap * 2, gap);
+    }
+}
+
+void layout_tile(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out) {
+    int nmaster = params->master_count < n ? params->master_count : n;
+    int master_width = area.width;
+
+    if (nmaster <= 0) {
+        column(area, n, params->gap, out);
+        return;
+    }
+    if (n > nmaster)
+        master_width = area.width * params->master_ratio;
+
+    column((WindowGeometry){ area.x, area.y, master_width, area.height }, nmaster, params->gap, out);
+    if (n > nmaster)
+        column((WindowGeometry){ area.x + master_width, area.y, area.width - master_width, area.height },
+               n - nmaster, params->gap, out + nmaster);
+}
+
+void layout_grid(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out) {
+    int cols = 1;
+
+    while (cols * cols < n)
+        cols++;
+    int rows = (n + cols - 1) / cols;
+    int height = area.height / rows;
+
+    for (int i = 0; i < n; i++) {
+        int row = i / cols;
+        int in_row = row == rows - 1 ? n - row * cols : cols;
+        int width = area.width / in_row;
+        int col = i % cols;
+        out[i] = cell(area.x + col * width, area.y + row * height, width, height, params->gap);
+    }
+}
+
+void layout_monocle(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out) {
+    for (int i = 0; i < n; i++)
+        out[i] = cell(area.x, area.y, area.width, area.height, params->gap);
+}
+
+void layout_scroll(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out) {
+    int width = area.width * params->master_ratio;
+    int visible, first = 0;
+
+    if (width <= 0 || width * n < area.width)
+        width = area.width / n;
+    visible = area.width / width;
+    if (visible < 1)
+        visible = 1;
+    if (params->focus >= visible)
+        first = params->focus - visible + 1;
+    if (first > n - visible)
+        first = n - visible > 0 ? n - visible : 0;
+    for (int i = 0; i < n; i++) {
+        int column = i - first;
+        out[i] = cell(area.x + column * width, area.y, width, area.height, params->gap);
+        if (column < 0 || column >= visible)
+            out[i].x = -10000;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#define LAYOUT_MIN_SIZE 32
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} WindowGeometry;
+
+typedef struct {
+    float master_ratio;
+    int master_count;
+    int gap;
+    int focus;
+} LayoutParams;
+
+typedef void (*LayoutFunc)(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out);
+
+typedef struct {
+    const char *name;
+    LayoutFunc arrange;
+} Layout;
+
+enum {
+    LAYOUT_TILE,
+    LAYOUT_GRID,
+    LAYOUT_MONOCLE,
+    LAYOUT_SCROLL,
+    LAYOUT_LAST
+};
+
+extern const Layout layouts[LAYOUT_LAST];
+
+void layout_tile(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out);
+void layout_grid(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out);
+void layout_monocle(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out);
+void layout_scroll(WindowGeometry area, int n, const LayoutParams *params, WindowGeometry *out);
+
+#endif
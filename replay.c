@@ -0,0 +1,709 @@
+#include "rude.h"
+
+#define NUMLOCK_KEYCODE 77
+#define BUCKET_FLUSH LASTEvent
+#define BUCKET_TIMER (LASTEvent + 1)
+#define BUCKET_EXTENSION (LASTEvent + 2)
+#define BUCKET_CONTROL (LASTEvent + 3)
+#define BUCKET_LAST (LASTEvent + 4)
+
+typedef struct {
+    const char *name;
+    unsigned long count;
+    Bool round_trip;
+} RequestCount;
+
+typedef struct {
+    unsigned long count;
+    unsigned long requests;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+} BucketStats;
+
+static RequestCount requests[] = {
+    { "XChangeProperty", 0, False },
+    { "XConfigureWindow", 0, False },
+    { "XCreateSimpleWindow", 0, False },
+    { "XDeleteProperty", 0, False },
+    { "XGetModifierMapping", 0, True },
+    { "XGetTransientForHint", 0, True },
+    { "XGetWMNormalHints", 0, True },
+    { "XGetWMProtocols", 0, True },
+    { "XGetWindowAttributes", 0, True },
+    { "XGetWindowProperty", 0, True },
+    { "XGrabButton", 0, False },
+    { "XGrabKey", 0, False },
+    { "XGrabServer", 0, False },
+    { "XInternAtoms", 0, True },
+    { "XKillClient", 0, False },
+    { "XMapWindow", 0, False },
+    { "XMoveWindow", 0, False },
+    { "XNoOp", 0, False },
+    { "XQueryTree", 0, True },
+    { "XRaiseWindow", 0, False },
+    { "XSelectInput", 0, False },
+    { "XSendEvent", 0, False },
+    { "XSetInputFocus", 0, False },
+    { "XSync", 0, True },
+    { "XSyncChangeAlarm", 0, False },
+    { "XSyncCreateAlarm", 0, False },
+    { "XSyncDestroyAlarm", 0, False },
+    { "XSyncQueryCounter", 0, True },
+    { "XUngrabButton", 0, False },
+    { "XUngrabKey", 0, False },
+    { "XUngrabPointer", 0, False },
+    { "XUngrabServer", 0, False },
+};
+
+static FILE *trace;
+static TraceHeader header;
+static TraceRecord pending;
+static Bool have_pending = False;
+static KeySym keysyms[256];
+static Screen fake_screen;
+static BucketStats buckets[BUCKET_LAST];
+static int current_bucket = BUCKET_FLUSH;
+static Atom next_atom = 1000;
+static unsigned char *payload;
+static size_t payload_size;
+
+static void request(const char *name) {
+    for (unsigned int i = 0; i < LENGTH(requests); i++) {
+        if (strcmp(requests[i].name, name) == 0) {
+            requests[i].count++;
+            break;
+        }
+    }
+    ((_XPrivDisplay)dpy)->request++;
+    buckets[current_bucket].requests++;
+}
+
+static void *copy_data(const void *data, size_t size) {
+    void *copy = malloc(size);
+
+    if (!copy) {
+        fprintf(stderr, "rude-replay: failed to allocate memory\n");
+        exit(1);
+    }
+    memcpy(copy, data, size);
+    return copy;
+}
+
+static size_t payload_length(TraceRecord *record) {
+    switch (record->kind) {
+        case TRACE_EVENT:
+        case TRACE_CHECKED:
+            return sizeof(XEvent);
+        case TRACE_CONTROL:
+            return record->value;
+        case TRACE_ATOMS:
+            return record->value * sizeof(Atom);
+        case TRACE_TREE:
+            return record->value * sizeof(Window);
+        case TRACE_STATE:
+            return record->value * sizeof(long);
+        case TRACE_FETCH:
+            return sizeof(TraceFetch);
+    }
+    return 0;
+}
+
+static Bool read_record(TraceRecord *record, XEvent *ev) {
+    size_t length;
+
+    if (have_pending) {
+        *record = pending;
+        have_pending = False;
+    } else if (fread(record, sizeof(*record), 1, trace) != 1) {
+        return False;
+    }
+    length = payload_length(record);
+    if (record->kind == TRACE_EVENT || record->kind == TRACE_CHECKED) {
+        if (fread(ev, sizeof(XEvent), 1, trace) != 1)
+            return False;
+        ev->xany.display = dpy;
+        return True;
+    }
+    if (length >= payload_size) {
+        payload_size = length + 1;
+        payload = realloc(payload, payload_size);
+        if (!payload) {
+            fprintf(stderr, "rude-replay: failed to allocate memory\n");
+            exit(1);
+        }
+    }
+    if (fread(payload, 1, length, trace) != length)
+        return False;
+    payload[length] = '\0';
+    return True;
+}
+
+static void push_back(TraceRecord *record) {
+    pending = *record;
+    have_pending = True;
+    fseek(trace, -(long)payload_length(record), SEEK_CUR);
+}
+
+static Bool next_record(unsigned int kind, TraceRecord *record) {
+    XEvent ev;
+
+    if (!read_record(record, &ev))
+        return False;
+    if (record->kind == kind)
+        return True;
+    push_back(record);
+    return False;
+}
+
+static WindowInfo *peek_fetch(Window w) {
+    TraceRecord record;
+    XEvent ev;
+
+    if (!read_record(&record, &ev))
+        return NULL;
+    push_back(&record);
+    if (record.kind != TRACE_FETCH || ((TraceFetch *)payload)->window != w)
+        return NULL;
+    return &((TraceFetch *)payload)->info;
+}
+
+static Bool peek_checked(XEvent *ev) {
+    TraceRecord record;
+
+    if (!read_record(&record, ev))
+        return False;
+    push_back(&record);
+    return record.kind == TRACE_CHECKED;
+}
+
+static unsigned long long elapsed_ns(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000000ULL + end.tv_nsec - start->tv_nsec;
+}
+
+static void account(int bucket, struct timespec *start) {
+    unsigned long long ns = elapsed_ns(start);
+
+    buckets[bucket].count++;
+    buckets[bucket].total_ns += ns;
+    if (ns > buckets[bucket].max_ns)
+        buckets[bucket].max_ns = ns;
+}
+
+static const char *bucket_name(int bucket) {
+    if (bucket == BUCKET_FLUSH)
+        return "flush";
+    if (bucket == BUCKET_TIMER)
+        return "timer";
+    if (bucket == BUCKET_EXTENSION)
+        return "extension";
+    if (bucket == BUCKET_CONTROL)
+        return "control";
+    return event_names[bucket] ? event_names[bucket] : "unknown";
+}
+
+static void print_report() {
+    unsigned long total = 0, round_trips = 0;
+
+    printf("%-18s %8s %12s %10s %10s %9s\n", "handler", "count", "total_us", "mean_us", "max_us", "requests");
+    for (int i = 0; i < BUCKET_LAST; i++) {
+        BucketStats *b = &buckets[i];
+        if (!b->count)
+            continue;
+        printf("%-18s %8lu %12.1f %10.2f %10.1f %9lu\n", bucket_name(i), b->count,
+               b->total_ns / 1000.0, b->total_ns / 1000.0 / b->count, b->max_ns / 1000.0, b->requests);
+    }
+    printf("\n%-22s %8s\n", "request", "count");
+    for (unsigned int i = 0; i < LENGTH(requests); i++) {
+        if (!requests[i].count)
+            continue;
+        printf("%-22s %8lu%s\n", requests[i].name, requests[i].count, requests[i].round_trip ? " (round trip)" : "");
+        total += requests[i].count;
+        if (requests[i].round_trip)
+            round_trips += requests[i].count;
+    }
+    printf("\n%lu requests, %lu round trips\n", total, round_trips);
+}
+
+int main(int argc, char *argv[]) {
+    TraceRecord record;
+    XEvent ev;
+    FILE *reply;
+    int fds[2];
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: rude-replay trace\n");
+        exit(1);
+    }
+    trace = fopen(argv[1], "rb");
+    if (!trace) {
+        perror("rude-replay: open");
+        exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, trace) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "rude-replay: %s is not a rude trace\n", argv[1]);
+        exit(1);
+    }
+    for (unsigned int i = 0; i < header.nkeys; i++) {
+        if (fread(&record, sizeof(record), 1, trace) != 1 || record.kind != TRACE_KEYCODE) {
+            fprintf(stderr, "rude-replay: truncated trace\n");
+            exit(1);
+        }
+        if (record.value < LENGTH(keysyms))
+            keysyms[record.value] = record.time;
+    }
+
+    dpy = calloc(1, sizeof(*(_XPrivDisplay)NULL));
+    if (dpy == NULL) {
+        fprintf(stderr, "rude-replay: failed to allocate memory\n");
+        exit(1);
+    }
+    fake_screen.root = header.root;
+    fake_screen.width = header.width;
+    fake_screen.height = header.height;
+    if (pipe(fds) < 0) {
+        perror("rude-replay: pipe");
+        exit(1);
+    }
+    ((_XPrivDisplay)dpy)->fd = fds[0];
+    ((_XPrivDisplay)dpy)->nscreens = 1;
+    ((_XPrivDisplay)dpy)->screens = &fake_screen;
+    reply = fopen("/dev/null", "w");
+    if (!reply) {
+        perror("rude-replay: /dev/null");
+        exit(1);
+    }
+
+    setup();
+    memset(buckets, 0, sizeof(buckets));
+    for (unsigned int i = 0; i < LENGTH(requests); i++)
+        requests[i].count = 0;
+
+    while (read_record(&record, &ev)) {
+        struct timespec start;
+
+        switch (record.kind) {
+            case TRACE_EVENT:
+                if (record.value)
+                    ((_XPrivDisplay)dpy)->request = record.value - 1;
+                current_bucket = ev.type < LASTEvent ? ev.type : BUCKET_EXTENSION;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                dispatch_event(&ev);
+                account(current_bucket, &start);
+                break;
+            case TRACE_FLUSH:
+                if (record.value)
+                    ((_XPrivDisplay)dpy)->request = record.value - 1;
+                current_bucket = BUCKET_FLUSH;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                flush_pending();
+                account(current_bucket, &start);
+                break;
+            case TRACE_TIMER:
+                if (record.value >= TIMER_LAST)
+                    break;
+                current_bucket = BUCKET_TIMER;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                fire_timer(record.value);
+                account(current_bucket, &start);
+                break;
+            case TRACE_CONTROL:
+                current_bucket = BUCKET_CONTROL;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                run_commands((char *)payload, reply);
+                account(current_bucket, &start);
+                break;
+            default:
+                break;
+        }
+    }
+    fclose(reply);
+    print_report();
+    fclose(trace);
+    return 0;
+}
+
+Display *XOpenDisplay(_Xconst char *name) {
+    return NULL;
+}
+
+int XCloseDisplay(Display *display) {
+    return 0;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+    return NULL;
+}
+
+int XPending(Display *display) {
+    return 0;
+}
+
+int XEventsQueued(Display *display, int mode) {
+    XEvent ev;
+    return peek_checked(&ev);
+}
+
+int XPeekEvent(Display *display, XEvent *ev) {
+    peek_checked(ev);
+    return 0;
+}
+
+int XNextEvent(Display *display, XEvent *ev) {
+    TraceRecord record;
+
+    if (!have_pending || pending.kind != TRACE_CHECKED || !read_record(&record, ev)) {
+        fprintf(stderr, "rude-replay: unexpected XNextEvent\n");
+        exit(1);
+    }
+    return 0;
+}
+
+Bool XCheckTypedEvent(Display *display, int type, XEvent *ev) {
+    TraceRecord record;
+    XEvent next;
+
+    if (!read_record(&record, &next))
+        return False;
+    if (record.kind == TRACE_CHECKED && next.type == type) {
+        *ev = next;
+        return True;
+    }
+    push_back(&record);
+    return False;
+}
+
+int XFlush(Display *display) {
+    return 1;
+}
+
+int XSync(Display *display, Bool discard) {
+    request("XSync");
+    return 1;
+}
+
+int XFree(void *data) {
+    free(data);
+    return 1;
+}
+
+Status XInternAtoms(Display *display, char **names, int count, Bool only_if_exists, Atom *atoms_return) {
+    TraceRecord record;
+
+    request("XInternAtoms");
+    if (next_record(TRACE_ATOMS, &record) && record.value == (unsigned int)count) {
+        memcpy(atoms_return, payload, count * sizeof(Atom));
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+        atoms_return[i] = next_atom++;
+    return 1;
+}
+
+KeyCode XKeysymToKeycode(Display *display, KeySym keysym) {
+    if (keysym == XK_Num_Lock)
+        return NUMLOCK_KEYCODE;
+    for (unsigned int i = 0; i < LENGTH(keysyms); i++)
+        if (keysyms[i] == keysym)
+            return i;
+    return 0;
+}
+
+XModifierKeymap *XGetModifierMapping(Display *display) {
+    XModifierKeymap *modmap = calloc(1, sizeof(XModifierKeymap));
+    KeyCode *map = calloc(8, sizeof(KeyCode));
+
+    request("XGetModifierMapping");
+    if (!modmap || !map) {
+        fprintf(stderr, "rude-replay: failed to allocate memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < 8; i++)
+        if (header.numlockmask & (1 << i))
+            map[i] = NUMLOCK_KEYCODE;
+    modmap->max_keypermod = 1;
+    modmap->modifiermap = map;
+    return modmap;
+}
+
+int XFreeModifiermap(XModifierKeymap *modmap) {
+    free(modmap->modifiermap);
+    free(modmap);
+    return 1;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev) {
+    return 1;
+}
+
+int XGetWindowProperty(Display *display, Window w, Atom property, long offset, long length, Bool delete,
+                       Atom req_type, Atom *actual_type, int *actual_format, unsigned long *nitems,
+                       unsigned long *bytes_after, unsigned char **prop) {
+    TraceRecord record;
+    WindowInfo *info;
+    unsigned long data[12];
+    unsigned long n = 0;
+
+    request("XGetWindowProperty");
+    *actual_type = None;
+    *actual_format = 0;
+    *nitems = 0;
+    *bytes_after = 0;
+    *prop = NULL;
+    if (property == atoms[ATOM_RUDE_STATE]) {
+        if (next_record(TRACE_STATE, &record) && record.value) {
+            *actual_type = XA_CARDINAL;
+            *actual_format = 32;
+            *nitems = record.value;
+            *prop = copy_data(payload, record.value * sizeof(long));
+        }
+        return Success;
+    }
+    if (!(info = peek_fetch(w)))
+        return Success;
+    if (property == atoms[ATOM_NET_WM_WINDOW_TYPE] && info->window_type) {
+        data[n++] = info->window_type;
+    } else if (property == atoms[ATOM_NET_WM_STATE] && (info->flags & CLIENT_FULLSCREEN)) {
+        data[n++] = atoms[ATOM_NET_WM_STATE_FULLSCREEN];
+    } else if (property == atoms[ATOM_NET_WM_STRUT_PARTIAL] && info->has_strut) {
+        memcpy(data, info->strut, sizeof(data));
+        n = LENGTH(data);
+    } else if (property == atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER] && info->sync_counter) {
+        data[n++] = info->sync_counter;
+    }
+    if (n) {
+        *actual_type = req_type;
+        *actual_format = 32;
+        *nitems = n;
+        *prop = copy_data(data, n * sizeof(unsigned long));
+    }
+    return Success;
+}
+
+Status XGetWindowAttributes(Display *display, Window w, XWindowAttributes *wa) {
+    WindowInfo *info = peek_fetch(w);
+
+    request("XGetWindowAttributes");
+    memset(wa, 0, sizeof(*wa));
+    wa->root = header.root;
+    if (!info) {
+        wa->width = 640;
+        wa->height = 480;
+        wa->map_state = IsViewable;
+        return 1;
+    }
+    if (!info->valid)
+        return 0;
+    wa->x = info->geom.x;
+    wa->y = info->geom.y;
+    wa->width = info->geom.width;
+    wa->height = info->geom.height;
+    wa->override_redirect = info->override_redirect;
+    wa->map_state = info->map_state;
+    return 1;
+}
+
+Status XGetWMNormalHints(Display *display, Window w, XSizeHints *hints, long *supplied) {
+    WindowInfo *info = peek_fetch(w);
+
+    request("XGetWMNormalHints");
+    if (!info || !(info->flags & CLIENT_HINTS))
+        return 0;
+    *hints = info->hints;
+    *supplied = info->hints.flags;
+    return 1;
+}
+
+Status XGetTransientForHint(Display *display, Window w, Window *transient_for) {
+    WindowInfo *info = peek_fetch(w);
+
+    request("XGetTransientForHint");
+    if (!info || !info->transient_for)
+        return 0;
+    *transient_for = info->transient_for;
+    return 1;
+}
+
+Status XGetWMProtocols(Display *display, Window w, Atom **protocols, int *count) {
+    WindowInfo *info = peek_fetch(w);
+    Atom list[2];
+    int n = 0;
+
+    request("XGetWMProtocols");
+    if (!info)
+        return 0;
+    if (info->flags & CLIENT_DELETE_WINDOW)
+        list[n++] = atoms[ATOM_WM_DELETE_WINDOW];
+    if (info->flags & CLIENT_SYNC_REQUEST)
+        list[n++] = atoms[ATOM_NET_WM_SYNC_REQUEST];
+    if (!n)
+        return 0;
+    *protocols = copy_data(list, n * sizeof(Atom));
+    *count = n;
+    return 1;
+}
+
+Status XQueryTree(Display *display, Window w, Window *root_return, Window *parent, Window **children,
+                  unsigned int *nchildren) {
+    TraceRecord record;
+
+    request("XQueryTree");
+    *children = NULL;
+    *nchildren = 0;
+    if (next_record(TRACE_TREE, &record) && record.value) {
+        *children = copy_data(payload, record.value * sizeof(Window));
+        *nchildren = record.value;
+    }
+    return 1;
+}
+
+void trace_fetch(unsigned int kind, Window w, WindowInfo *info) {
+    TraceRecord record;
+
+    if (peek_fetch(w) && next_record(TRACE_FETCH, &record))
+        *info = ((TraceFetch *)payload)->info;
+}
+
+Window XCreateSimpleWindow(Display *display, Window parent, int x, int y, unsigned int width,
+                           unsigned int height, unsigned int border_width, unsigned long border,
+                           unsigned long background) {
+    request("XCreateSimpleWindow");
+    return header.root + 1;
+}
+
+int XChangeProperty(Display *display, Window w, Atom property, Atom type, int format, int mode,
+                    const unsigned char *data, int nelements) {
+    request("XChangeProperty");
+    return 1;
+}
+
+int XDeleteProperty(Display *display, Window w, Atom property) {
+    request("XDeleteProperty");
+    return 1;
+}
+
+int XConfigureWindow(Display *display, Window w, unsigned int mask, XWindowChanges *changes) {
+    request("XConfigureWindow");
+    return 1;
+}
+
+int XMoveWindow(Display *display, Window w, int x, int y) {
+    request("XMoveWindow");
+    return 1;
+}
+
+int XMapWindow(Display *display, Window w) {
+    request("XMapWindow");
+    return 1;
+}
+
+int XNoOp(Display *display) {
+    request("XNoOp");
+    return 1;
+}
+
+int XRaiseWindow(Display *display, Window w) {
+    request("XRaiseWindow");
+    return 1;
+}
+
+int XSelectInput(Display *display, Window w, long mask) {
+    request("XSelectInput");
+    return 1;
+}
+
+Status XSendEvent(Display *display, Window w, Bool propagate, long mask, XEvent *ev) {
+    request("XSendEvent");
+    return 1;
+}
+
+int XSetInputFocus(Display *display, Window focus, int revert_to, Time time) {
+    request("XSetInputFocus");
+    return 1;
+}
+
+int XKillClient(Display *display, XID resource) {
+    request("XKillClient");
+    return 1;
+}
+
+int XGrabServer(Display *display) {
+    request("XGrabServer");
+    return 1;
+}
+
+int XUngrabServer(Display *display) {
+    request("XUngrabServer");
+    return 1;
+}
+
+int XGrabKey(Display *display, int keycode, unsigned int modifiers, Window grab_window, Bool owner_events,
+             int pointer_mode, int keyboard_mode) {
+    request("XGrabKey");
+    return 1;
+}
+
+int XUngrabKey(Display *display, int keycode, unsigned int modifiers, Window grab_window) {
+    request("XUngrabKey");
+    return 1;
+}
+
+int XGrabButton(Display *display, unsigned int button, unsigned int modifiers, Window grab_window,
+                Bool owner_events, unsigned int event_mask, int pointer_mode, int keyboard_mode,
+                Window confine_to, Cursor cursor) {
+    request("XGrabButton");
+    return 1;
+}
+
+int XUngrabButton(Display *display, unsigned int button, unsigned int modifiers, Window grab_window) {
+    request("XUngrabButton");
+    return 1;
+}
+
+int XUngrabPointer(Display *display, Time time) {
+    request("XUngrabPointer");
+    return 1;
+}
+
+Status XSyncQueryExtension(Display *display, int *event_base, int *error_base) {
+    return False;
+}
+
+Status XSyncInitialize(Display *display, int *major, int *minor) {
+    return False;
+}
+
+Status XSyncQueryCounter(Display *display, XSyncCounter counter, XSyncValue *value) {
+    request("XSyncQueryCounter");
+    memset(value, 0, sizeof(*value));
+    return 1;
+}
+
+XSyncAlarm XSyncCreateAlarm(Display *display, unsigned long mask, XSyncAlarmAttributes *attr) {
+    request("XSyncCreateAlarm");
+    return None;
+}
+
+Status XSyncChangeAlarm(Display *display, XSyncAlarm alarm, unsigned long mask, XSyncAlarmAttributes *attr) {
+    request("XSyncChangeAlarm");
+    return 1;
+}
+
+Status XSyncDestroyAlarm(Display *display, XSyncAlarm alarm) {
+    request("XSyncDestroyAlarm");
+    return 1;
+}
+
+void XSyncIntsToValue(XSyncValue *value, unsigned int low, int high) {
+    value->lo = low;
+    value->hi = high;
+}
+
+int XSyncValueHigh32(XSyncValue value) {
+    return value.hi;
+}
+
+unsigned int XSyncValueLow32(XSyncValue value) {
+    return value.lo;
+}
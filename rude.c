@@ -3,570 +3,2857 @@
 Display *dpy;
 Window root;
 int screen;
-Window *clients = NULL;
-int nclients = 0;
+Desktop desktops[NUM_DESKTOPS];
 int current_client = -1;
 unsigned int current_desktop = 0;
-Window **desktop_clients = NULL;
-int *desktop_nclients = NULL;
+Bool client_list_dirty = False;
+Bool running = True;
+Bool restarting = False;
+#ifdef STATS
+Stats stats;
+#endif
 Bool is_floating_mode = False;
-XWindowAttributes wa;
+WindowGeometry drag_geom;
+unsigned int numlockmask = 0;
+Window focused_window = None;
+Window top_window = None;
+unsigned long enter_serial = 0;
+Bool have_sync = False;
+int sync_event_base = 0;
 XButtonEvent start;
-WindowGeometry *window_geometries = NULL;
+unsigned int motion_interval = 0;
+Time motion_time = 0;
+Bool motion_pending = False;
+Atom atoms[ATOM_LAST];
+Strut *struts = NULL;
+int nstruts = 0;
+Bool struts_dirty = True;
+Monitor monitors[MAX_MONITORS];
+int nmonitors = 0;
+Bool monitors_dirty = False;
+Bool have_randr = False;
+int randr_event_base = 0;
 
-void get_strut_partial(Window w, unsigned long *strut) {
+static Client **client_table = NULL;
+static unsigned int client_table_size = 0;
+static unsigned int client_table_count = 0;
+static Client *client_pool = NULL;
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int signal_fd = -1;
+static long long timer_deadlines[TIMER_LAST];
+static FILE *trace_file = NULL;
+static Display *worker_dpy = NULL;
+static pthread_t fetcher;
+static atomic_bool fetcher_quit = False;
+static int fetch_request_fd = -1;
+static int fetch_result_fd = -1;
+static FetchQueue fetch_requests;
+static FetchQueue fetch_results;
+static PendingFetch fetching[FETCH_QUEUE_SIZE];
+static int nfetching = 0;
+static unsigned long fetch_serial = 0;
+static int control_fd = -1;
+static char control_path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+static ControlClient controls[MAX_CONTROLS];
+static Bool batching = False;
+
+static const Key keys[] = {
+    { MODKEY, XK_q,     kill_focused,    {0} },
+    { MODKEY | ShiftMask, XK_r, restart,   {0} },
+    { MODKEY, XK_Tab,   focus_next,      {0} },
+    { MODKEY, XK_space, toggle_floating, {0} },
+    { MODKEY, XK_t,     set_layout,      {.ui = LAYOUT_TILE} },
+    { MODKEY, XK_g,     set_layout,      {.ui = LAYOUT_GRID} },
+    { MODKEY, XK_m,     set_layout,      {.ui = LAYOUT_MONOCLE} },
+    { MODKEY, XK_s,     set_layout,      {.ui = LAYOUT_SCROLL} },
+    { MODKEY, XK_h,     adjust_master_ratio, {.f = -0.05} },
+    { MODKEY, XK_l,     adjust_master_ratio, {.f = +0.05} },
+    { MODKEY, XK_i,     adjust_master_count, {.i = +1} },
+    { MODKEY, XK_d,     adjust_master_count, {.i = -1} },
+    { MODKEY, XK_1,     view_desktop,    {.ui = 0} },
+    { MODKEY, XK_2,     view_desktop,    {.ui = 1} },
+    { MODKEY, XK_3,     view_desktop,    {.ui = 2} },
+    { MODKEY, XK_4,     view_desktop,    {.ui = 3} },
+    { MODKEY, XK_5,     view_desktop,    {.ui = 4} },
+};
+
+static const Command commands[] = {
+    { "focus",   cmd_focus },
+    { "kill",    cmd_kill },
+    { "move",    cmd_move },
+    { "desktop", cmd_desktop },
+    { "layout",  cmd_layout },
+    { "float",   cmd_float },
+};
+
+static int key_first[256];
+static int key_next[LENGTH(keys)];
+
+static void (*timer_funcs[TIMER_LAST])(void) = {
+    [TIMER_DRAG] = drag_timeout,
+    [TIMER_SYNC] = sync_timeout,
+};
+
+const char *event_names[LASTEvent] = {
+    [KeyPress] = "KeyPress",
+    [KeyRelease] = "KeyRelease",
+    [ButtonPress] = "ButtonPress",
+    [ButtonRelease] = "ButtonRelease",
+    [MotionNotify] = "MotionNotify",
+    [EnterNotify] = "EnterNotify",
+    [LeaveNotify] = "LeaveNotify",
+    [FocusIn] = "FocusIn",
+    [FocusOut] = "FocusOut",
+    [KeymapNotify] = "KeymapNotify",
+    [Expose] = "Expose",
+    [GraphicsExpose] = "GraphicsExpose",
+    [NoExpose] = "NoExpose",
+    [VisibilityNotify] = "VisibilityNotify",
+    [CreateNotify] = "CreateNotify",
+    [DestroyNotify] = "DestroyNotify",
+    [UnmapNotify] = "UnmapNotify",
+    [MapNotify] = "MapNotify",
+    [MapRequest] = "MapRequest",
+    [ReparentNotify] = "ReparentNotify",
+    [ConfigureNotify] = "ConfigureNotify",
+    [ConfigureRequest] = "ConfigureRequest",
+    [GravityNotify] = "GravityNotify",
+    [ResizeRequest] = "ResizeRequest",
+    [CirculateNotify] = "CirculateNotify",
+    [CirculateRequest] = "CirculateRequest",
+    [PropertyNotify] = "PropertyNotify",
+    [SelectionClear] = "SelectionClear",
+    [SelectionRequest] = "SelectionRequest",
+    [SelectionNotify] = "SelectionNotify",
+    [ColormapNotify] = "ColormapNotify",
+    [ClientMessage] = "ClientMessage",
+    [MappingNotify] = "MappingNotify",
+    [GenericEvent] = "GenericEvent",
+};
+
+static char *atom_names[ATOM_LAST] = {
+    [ATOM_WM_PROTOCOLS] = "WM_PROTOCOLS",
+    [ATOM_WM_DELETE_WINDOW] = "WM_DELETE_WINDOW",
+    [ATOM_UTF8_STRING] = "UTF8_STRING",
+    [ATOM_NET_SUPPORTED] = "_NET_SUPPORTED",
+    [ATOM_NET_WM_STATE] = "_NET_WM_STATE",
+    [ATOM_NET_WM_STATE_FULLSCREEN] = "_NET_WM_STATE_FULLSCREEN",
+    [ATOM_NET_ACTIVE_WINDOW] = "_NET_ACTIVE_WINDOW",
+    [ATOM_NET_WM_NAME] = "_NET_WM_NAME",
+    [ATOM_NET_SUPPORTING_WM_CHECK] = "_NET_SUPPORTING_WM_CHECK",
+    [ATOM_NET_CLIENT_LIST] = "_NET_CLIENT_LIST",
+    [ATOM_NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP",
+    [ATOM_NET_NUMBER_OF_DESKTOPS] = "_NET_NUMBER_OF_DESKTOPS",
+    [ATOM_NET_WM_DESKTOP] = "_NET_WM_DESKTOP",
+    [ATOM_NET_CLOSE_WINDOW] = "_NET_CLOSE_WINDOW",
+    [ATOM_NET_WM_STRUT] = "_NET_WM_STRUT",
+    [ATOM_NET_WM_STRUT_PARTIAL] = "_NET_WM_STRUT_PARTIAL",
+    [ATOM_NET_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+    [ATOM_NET_WM_WINDOW_TYPE_DOCK] = "_NET_WM_WINDOW_TYPE_DOCK",
+    [ATOM_NET_WM_WINDOW_TYPE_DIALOG] = "_NET_WM_WINDOW_TYPE_DIALOG",
+    [ATOM_NET_WM_WINDOW_TYPE_UTILITY] = "_NET_WM_WINDOW_TYPE_UTILITY",
+    [ATOM_NET_WM_WINDOW_TYPE_SPLASH] = "_NET_WM_WINDOW_TYPE_SPLASH",
+    [ATOM_NET_WM_WINDOW_TYPE_TOOLBAR] = "_NET_WM_WINDOW_TYPE_TOOLBAR",
+    [ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION] = "_NET_WM_WINDOW_TYPE_NOTIFICATION",
+    [ATOM_NET_WM_SYNC_REQUEST] = "_NET_WM_SYNC_REQUEST",
+    [ATOM_NET_WM_SYNC_REQUEST_COUNTER] = "_NET_WM_SYNC_REQUEST_COUNTER",
+    [ATOM_RUDE_STATE] = "_RUDE_STATE",
+    [ATOM_RUDE_STATS] = "_RUDE_STATS",
+};
+
+Bool get_strut_partial(Display *display, Window w, unsigned long *strut) {
     Atom actual_type;
     int actual_format;
     unsigned long nitems, bytes_after;
     unsigned long *data = NULL;
-    Atom net_wm_strut_partial = XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False);
+    Atom props[] = { atoms[ATOM_NET_WM_STRUT_PARTIAL], atoms[ATOM_NET_WM_STRUT] };
+
+    memset(strut, 0, 12 * sizeof(unsigned long));
+    for (int i = 0; i < 2; i++) {
+        STAT_ROUND_TRIP(display);
+        if (XGetWindowProperty(display, w, props[i], 0, 12, False, XA_CARDINAL,
+                              &actual_type, &actual_format, &nitems, &bytes_after,
+                              (unsigned char **)&data) == Success && data) {
+            if (actual_format == 32 && nitems >= 4) {
+                memcpy(strut, data, (nitems < 12 ? nitems : 12) * sizeof(unsigned long));
+                XFree(data);
+                return True;
+            }
+            XFree(data);
+            data = NULL;
+        }
+    }
+    return False;
+}
+
+void adopt_windows() {
+    Window *windows = NULL;
+    unsigned int num_windows;
+    Window dummy1, dummy2;
+    unsigned long nstate = 0;
+    long *state = load_state(&nstate);
+
+    XGrabServer(dpy);
+    STAT_INC(round_trips);
+    if (!XQueryTree(dpy, root, &dummy1, &dummy2, &windows, &num_windows)) {
+        XUngrabServer(dpy);
+        XFree(state);
+        return;
+    }
+    trace_data(TRACE_TREE, num_windows, windows, num_windows * sizeof(Window));
+
+    WindowInfo *infos = calloc(num_windows ? num_windows : 1, sizeof(WindowInfo));
+    if (infos == NULL) {
+        fprintf(stderr, "rude: failed to allocate memory\n");
+        exit(1);
+    }
+    for (unsigned int i = 0; i < num_windows; i++) {
+        fetch_window_info(dpy, windows[i], &infos[i]);
+        trace_fetch(FETCH_MAP, windows[i], &infos[i]);
+        if (!infos[i].valid || infos[i].override_redirect || infos[i].map_state != IsViewable) {
+            infos[i].valid = False;
+            continue;
+        }
+        if (set_strut(windows[i], infos[i].has_strut, infos[i].strut))
+            mark_all_layouts_dirty();
+        if (infos[i].window_type == atoms[ATOM_NET_WM_WINDOW_TYPE_DOCK]) {
+            XSelectInput(dpy, windows[i], PropertyChangeMask);
+            infos[i].valid = False;
+        }
+    }
+
+    unsigned long pos = 4;
+    if (state && nstate >= 4 && state[0] == STATE_VERSION && state[3] == NUM_DESKTOPS) {
+        for (unsigned int d = 0; d < NUM_DESKTOPS && pos + 6 <= nstate; d++) {
+            long *desktop = &state[pos];
+            pos += 6;
+            if (desktop[0] >= 0 && desktop[0] < LAYOUT_LAST)
+                desktops[d].layout = desktop[0];
+            if (desktop[1] >= 100 && desktop[1] <= 900)
+                desktops[d].master_ratio = desktop[1] / 1000.0;
+            if (desktop[2] >= 0)
+                desktops[d].master_count = desktop[2];
+            if (desktop[3] >= 0 && desktop[3] < nmonitors) {
+                desktops[d].monitor = desktop[3];
+                if (desktop[4])
+                    monitors[desktop[3]].desktop = d;
+            }
+            for (long j = 0; j < desktop[5] && pos + 6 <= nstate; j++, pos += 6) {
+                long *s = &state[pos];
+                for (unsigned int i = 0; i < num_windows; i++) {
+                    if (!infos[i].valid || windows[i] != (Window)s[0])
+                        continue;
+                    Client *c = add_client(windows[i], &infos[i], d);
+                    c->flags |= s[1] & CLIENT_FLOATING;
+                    c->geom = (WindowGeometry){ s[2], s[3], s[4], s[5] };
+                    infos[i].valid = False;
+                    break;
+                }
+            }
+        }
+        if (state[1] >= 0 && state[1] < NUM_DESKTOPS && desktop_visible(state[1]))
+            current_desktop = state[1];
+        if (state[2] && !is_floating_mode) {
+            is_floating_mode = True;
+            grab_buttons();
+        }
+    }
+    for (unsigned int i = 0; i < num_windows; i++)
+        if (infos[i].valid)
+            add_client(windows[i], &infos[i], current_desktop);
+
+    for (int d = 0; d < NUM_DESKTOPS; d++) {
+        for (int j = 0; j < desktops[d].nclients; j++) {
+            Client *c = desktops[d].clients[j];
+            XSelectInput(dpy, c->window, CLIENT_EVENT_MASK);
+            if (!desktop_visible(d))
+                configure_client(c, -10000, c->applied.y, c->applied.width, c->applied.height);
+            else if (c->flags & CLIENT_FULLSCREEN)
+                place_fullscreen(c);
+            else if (is_floating_mode || (c->flags & CLIENT_FLOATING))
+                configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+        }
+    }
+    mark_all_layouts_dirty();
+    if (desktops[current_desktop].nclients > 0)
+        focus_client(0);
+    XUngrabServer(dpy);
+
+    free(infos);
+    if (windows)
+        XFree(windows);
+    if (state)
+        XFree(state);
+}
+
+long *load_state(unsigned long *nitems) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long bytes_after;
+    long *data = NULL;
+
+    *nitems = 0;
+    STAT_INC(round_trips);
+    if (XGetWindowProperty(dpy, root, atoms[ATOM_RUDE_STATE], 0, LONG_MAX / 4, True, XA_CARDINAL,
+                           &actual_type, &actual_format, nitems, &bytes_after,
+                           (unsigned char **)&data) != Success || !data)
+        return NULL;
+    if (actual_format != 32) {
+        XFree(data);
+        *nitems = 0;
+        return NULL;
+    }
+    trace_data(TRACE_STATE, *nitems, data, *nitems * sizeof(long));
+    return data;
+}
+
+void save_state() {
+    unsigned long n = 4 + NUM_DESKTOPS * 6;
+    unsigned long pos = 0;
+
+    for (int d = 0; d < NUM_DESKTOPS; d++)
+        n += desktops[d].nclients * 6;
+    long *state = malloc(sizeof(long) * n);
+    if (state == NULL) {
+        fprintf(stderr, "rude: failed to allocate memory\n");
+        exit(1);
+    }
+
+    state[pos++] = STATE_VERSION;
+    state[pos++] = current_desktop;
+    state[pos++] = is_floating_mode;
+    state[pos++] = NUM_DESKTOPS;
+    for (int d = 0; d < NUM_DESKTOPS; d++) {
+        Desktop *desktop = &desktops[d];
+        state[pos++] = desktop->layout;
+        state[pos++] = desktop->master_ratio * 1000 + 0.5;
+        state[pos++] = desktop->master_count;
+        state[pos++] = desktop->monitor;
+        state[pos++] = desktop_visible(d);
+        state[pos++] = desktop->nclients;
+        for (int j = 0; j < desktop->nclients; j++) {
+            Client *c = desktop->clients[j];
+            state[pos++] = c->window;
+            state[pos++] = c->flags & CLIENT_FLOATING;
+            state[pos++] = c->geom.x;
+            state[pos++] = c->geom.y;
+            state[pos++] = c->geom.width;
+            state[pos++] = c->geom.height;
+        }
+    }
+    XChangeProperty(dpy, root, atoms[ATOM_RUDE_STATE], XA_CARDINAL, 32, PropModeReplace,
+                    (unsigned char *)state, n);
+    free(state);
+}
+
+#ifdef STATS
+void publish_stats() {
+    long values[] = {
+        NextRequest(dpy) - 1,
+        stats.round_trips,
+        stats.configures
+    };
+
+    XChangeProperty(dpy, root, atoms[ATOM_RUDE_STATS], XA_CARDINAL, 32, PropModeReplace,
+                    (unsigned char *)values, LENGTH(values));
+}
+
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void record_latency(Histogram *h, long long ns) {
+    unsigned long long us = ns / 1000;
+    int bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+    h->count++;
+    h->total_ns += ns;
+    if ((unsigned long long)ns > h->max_ns)
+        h->max_ns = ns;
+    h->buckets[MIN(bucket, HIST_BUCKETS - 1)]++;
+}
+
+static unsigned long long percentile_us(Histogram *h, double p) {
+    unsigned long target = h->count * p, seen = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > target)
+            return 1ULL << i;
+    }
+    return 1ULL << HIST_BUCKETS;
+}
+
+static void dump_histogram(FILE *f, Bool json, const char *name, Histogram *h, Bool *first) {
+    if (!h->count)
+        return;
+    if (!json) {
+        fprintf(f, "rude: %-16s count=%lu mean=%.1fus max=%.1fus p50<%lluus p99<%lluus\n", name, h->count,
+                h->total_ns / 1000.0 / h->count, h->max_ns / 1000.0,
+                percentile_us(h, 0.5), percentile_us(h, 0.99));
+        return;
+    }
+    fprintf(f, "%s\"%s\":{\"count\":%lu,\"total_ns\":%llu,\"max_ns\":%llu,\"buckets_us\":[",
+            *first ? "" : ",", name, h->count, h->total_ns, h->max_ns);
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        fprintf(f, "%s%lu", i ? "," : "", h->buckets[i]);
+    fprintf(f, "]}");
+    *first = False;
+}
+
+void dump_stats(FILE *f, Bool json) {
+    static const char *func_names[STAT_LAST] = {
+        [STAT_TILE] = "tile_windows",
+        [STAT_SWITCH] = "switch_desktop",
+        [STAT_FOCUS] = "focus_client",
+    };
+    unsigned long requests = NextRequest(dpy) - 1;
+    Bool first = True;
+
+    if (json)
+        fprintf(f, "{\"requests\":%lu,\"round_trips\":%lu,\"async_requests\":%lu,\"configures\":%lu,\"events\":{",
+                requests, stats.round_trips, requests - stats.round_trips, stats.configures);
+    else
+        fprintf(f, "rude: %lu requests, %lu round trips, %lu async, %lu configures\n",
+                requests, stats.round_trips, requests - stats.round_trips, stats.configures);
+    for (int i = 0; i <= LASTEvent; i++) {
+        const char *name = i < LASTEvent && event_names[i] ? event_names[i] : "extension";
+        dump_histogram(f, json, name, &stats.events[i], &first);
+    }
+    if (json)
+        fprintf(f, "},\"functions\":{");
+    first = True;
+    for (int i = 0; i < STAT_LAST; i++)
+        dump_histogram(f, json, func_names[i], &stats.funcs[i], &first);
+    if (json)
+        fprintf(f, "}}\n");
+    fflush(f);
+}
+#endif
+
+void restart(const Arg *arg) {
+    restarting = True;
+    running = False;
+}
+
+Bool set_strut(Window w, Bool has_strut, unsigned long *strut) {
+    has_strut = has_strut && (strut[0] || strut[1] || strut[2] || strut[3]);
+
+    for (int i = 0; i < nstruts; i++) {
+        if (struts[i].window == w) {
+            if (!has_strut)
+                return remove_strut(w);
+            if (memcmp(struts[i].strut, strut, sizeof(struts[i].strut)) == 0)
+                return False;
+            memcpy(struts[i].strut, strut, sizeof(struts[i].strut));
+            struts_dirty = True;
+            return True;
+        }
+    }
+    if (!has_strut)
+        return False;
+
+    Strut *new_struts = realloc(struts, sizeof(Strut) * (nstruts + 1));
+    if (new_struts == NULL) {
+        fprintf(stderr, "rude: failed to allocate memory\n");
+        exit(1);
+    }
+    struts = new_struts;
+    struts[nstruts].window = w;
+    memcpy(struts[nstruts].strut, strut, sizeof(struts[nstruts].strut));
+    nstruts++;
+    struts_dirty = True;
+    return True;
+}
+
+Bool remove_strut(Window w) {
+    for (int i = 0; i < nstruts; i++) {
+        if (struts[i].window == w) {
+            struts[i] = struts[--nstruts];
+            struts_dirty = True;
+            return True;
+        }
+    }
+    return False;
+}
+
+static Bool strut_spans(unsigned long start, unsigned long end, int pos, int length) {
+    if (start == 0 && end == 0)
+        return True;
+    return (long)start < pos + length && (long)end >= pos;
+}
+
+void update_workarea() {
+    int sw = DisplayWidth(dpy, screen);
+    int sh = DisplayHeight(dpy, screen);
+
+    for (int m = 0; m < nmonitors; m++) {
+        WindowGeometry g = monitors[m].geom;
+        int left = g.x, right = g.x + g.width;
+        int top = g.y, bottom = g.y + g.height;
+
+        for (int i = 0; i < nstruts; i++) {
+            unsigned long *s = struts[i].strut;
+            Client *c = find_client(struts[i].window);
+            if (c && (c->flags & CLIENT_FULLSCREEN))
+                continue;
+            if (s[0] && (long)s[0] < right && strut_spans(s[4], s[5], g.y, g.height))
+                left = MAX(left, (int)s[0]);
+            if (s[1] && sw - (long)s[1] > left && strut_spans(s[6], s[7], g.y, g.height))
+                right = MIN(right, sw - (int)s[1]);
+            if (s[2] && (long)s[2] < bottom && strut_spans(s[8], s[9], g.x, g.width))
+                top = MAX(top, (int)s[2]);
+            if (s[3] && sh - (long)s[3] > top && strut_spans(s[10], s[11], g.x, g.width))
+                bottom = MIN(bottom, sh - (int)s[3]);
+        }
+        monitors[m].workarea = (WindowGeometry){ left, top, right - left, bottom - top };
+    }
+    struts_dirty = False;
+}
+
+void setup_monitors() {
+#ifdef XRANDR
+    int error_base, major, minor;
+
+    have_randr = XRRQueryExtension(dpy, &randr_event_base, &error_base) &&
+                 XRRQueryVersion(dpy, &major, &minor) && (major > 1 || minor >= 5);
+    if (have_randr)
+        XRRSelectInput(dpy, root, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask | RROutputChangeNotifyMask);
+#endif
+    update_monitors();
+}
+
+void update_monitors() {
+    WindowGeometry geoms[MAX_MONITORS];
+    int n = 0, old = nmonitors;
+
+    monitors_dirty = False;
+#ifdef XRANDR
+    if (have_randr) {
+        int count;
+        STAT_INC(round_trips);
+        XRRMonitorInfo *info = XRRGetMonitors(dpy, root, True, &count);
+        if (info) {
+            for (int i = 0; i < count && n < MIN(MAX_MONITORS, NUM_DESKTOPS); i++) {
+                geoms[n] = (WindowGeometry){ info[i].x, info[i].y, info[i].width, info[i].height };
+                if (info[i].primary && n > 0) {
+                    geoms[n] = geoms[0];
+                    geoms[0] = (WindowGeometry){ info[i].x, info[i].y, info[i].width, info[i].height };
+                }
+                n++;
+            }
+            XRRFreeMonitors(info);
+        }
+    }
+#endif
+    if (n == 0)
+        geoms[n++] = (WindowGeometry){ 0, 0, DisplayWidth(dpy, screen), DisplayHeight(dpy, screen) };
+
+    for (int m = n; m < old; m++) {
+        Desktop *d = &desktops[monitors[m].desktop];
+        for (int i = 0; i < d->nclients; i++) {
+            Client *c = d->clients[i];
+            configure_client(c, -10000, c->applied.y, c->applied.width, c->applied.height);
+        }
+    }
+    for (int m = 0; m < MIN(n, old); m++) {
+        if (memcmp(&monitors[m].geom, &geoms[m], sizeof(WindowGeometry)) == 0)
+            continue;
+        monitors[m].geom = geoms[m];
+        for (int i = 0; i < NUM_DESKTOPS; i++)
+            if (desktops[i].monitor == m)
+                mark_layout_dirty(i);
+        struts_dirty = True;
+    }
+
+    nmonitors = n;
+    for (int m = old; m < n; m++)
+        monitors[m].desktop = NUM_DESKTOPS;
+    for (int i = 0; i < NUM_DESKTOPS; i++)
+        if (desktops[i].monitor < 0 || desktops[i].monitor >= n)
+            desktops[i].monitor = i % n;
+    for (int m = old; m < n; m++) {
+        unsigned int desktop = NUM_DESKTOPS;
+        for (unsigned int i = 0; i < NUM_DESKTOPS && desktop == NUM_DESKTOPS; i++)
+            if (desktops[i].monitor == m && !desktop_visible(i))
+                desktop = i;
+        for (unsigned int i = 0; i < NUM_DESKTOPS && desktop == NUM_DESKTOPS; i++)
+            if (!desktop_visible(i))
+                desktop = i;
+        monitors[m].geom = geoms[m];
+        monitors[m].desktop = desktop;
+        desktops[desktop].monitor = m;
+        mark_layout_dirty(desktop);
+        struts_dirty = True;
+    }
+
+    if (!desktop_visible(current_desktop)) {
+        current_desktop = monitors[0].desktop;
+        current_client = -1;
+        focus_client(0);
+    }
+}
+
+void handle_screenchange(XEvent *e) {
+#ifdef XRANDR
+    if (e->type == randr_event_base + RRScreenChangeNotify)
+        XRRUpdateConfiguration(e);
+#endif
+    monitors_dirty = True;
+}
+
+Monitor *desktop_monitor(unsigned int desktop) {
+    return &monitors[desktops[desktop].monitor];
+}
+
+Bool desktop_visible(unsigned int desktop) {
+    int m = desktops[desktop].monitor;
+    return m >= 0 && m < nmonitors && monitors[m].desktop == desktop;
+}
+
+#ifndef RUDE_REPLAY
+int main(int argc, char *argv[]) {
+    XInitThreads();
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        fprintf(stderr, "rude: cannot open display\n");
+        exit(1);
+    }
+    setup();
+    setup_control();
+    run();
+    if (restarting) {
+        stop_fetcher();
+        save_state();
+        XCloseDisplay(dpy);
+        if (trace_file) {
+            fclose(trace_file);
+            unsetenv("RUDE_TRACE");
+        }
+        execvp(argv[0], argv);
+        perror("rude: execvp");
+        exit(1);
+    }
+    cleanup();
+    XCloseDisplay(dpy);
+    return 0;
+}
+#endif
+
+void setup() {
+    screen = DefaultScreen(dpy);
+    root = RootWindow(dpy, screen);
+    XSetErrorHandler(xerror);
+    XSelectInput(dpy, root, SubstructureRedirectMask | SubstructureNotifyMask | PointerMotionMask | EnterWindowMask);
+
+    grab_keys();
+#ifndef RUDE_REPLAY
+    setup_trace();
+#endif
+    setup_desktops();
+    setup_atoms();
+    setup_motion_rate();
+    setup_sync();
+    setup_monitors();
+    setup_ewmh();
+    adopt_windows();
+    update_net_number_of_desktops();
+    update_net_current_desktop();
+    setup_loop();
+    setup_fetcher();
+}
+
+void setup_desktops() {
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        desktops[i].layout = LAYOUT_TILE;
+        desktops[i].master_ratio = MASTER_RATIO;
+        desktops[i].master_count = MASTER_COUNT;
+        desktops[i].monitor = -1;
+    }
+}
+
+void setup_loop() {
+    struct epoll_event ev = { .events = EPOLLIN };
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        perror("rude: sigprocmask");
+        exit(1);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0 || signal_fd < 0) {
+        perror("rude: failed to set up event loop");
+        exit(1);
+    }
+
+    int fds[] = { ConnectionNumber(dpy), timer_fd, signal_fd };
+    for (int i = 0; i < 3; i++) {
+        ev.data.fd = fds[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &ev) < 0) {
+            perror("rude: epoll_ctl");
+            exit(1);
+        }
+    }
+}
+
+void cleanup() {
+    stop_fetcher();
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        for (int j = 0; j < desktops[i].nclients; j++) {
+            Client *c = desktops[i].clients[j];
+            if (c->applied.x <= -9000)
+                XMoveWindow(dpy, c->window, 0, c->applied.y);
+        }
+    }
+    XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
+    XDeleteProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW]);
+    XSync(dpy, False);
+
+    for (int i = 0; i < MAX_CONTROLS; i++)
+        if (controls[i].fd >= 0)
+            close_control(&controls[i]);
+    if (control_fd >= 0) {
+        close(control_fd);
+        unlink(control_path);
+    }
+    close(signal_fd);
+    close(timer_fd);
+    close(epoll_fd);
+    if (trace_file)
+        fclose(trace_file);
+}
+
+void run() {
+    XEvent ev;
+    struct epoll_event events[8];
+
+    while (running) {
+        while (XPending(dpy)) {
+            XNextEvent(dpy, &ev);
+            trace_record(TRACE_EVENT, NextRequest(dpy), &ev);
+            STAT_BEGIN(start);
+            dispatch_event(&ev);
+            STAT_END(events[MIN(ev.type, LASTEvent)], start);
+        }
+        trace_record(TRACE_FLUSH, NextRequest(dpy), NULL);
+        flush_pending();
+        if (XPending(dpy))
+            continue;
+
+        arm_timer();
+        int n = epoll_wait(epoll_fd, events, LENGTH(events), -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("rude: epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == timer_fd) {
+                unsigned long long expirations;
+                while (read(timer_fd, &expirations, sizeof(expirations)) > 0);
+                run_timers();
+            } else if (events[i].data.fd == signal_fd) {
+                handle_signals();
+            } else if (events[i].data.fd == fetch_result_fd) {
+                drain_fetches();
+            } else {
+                handle_control(events[i].data.fd);
+            }
+        }
+    }
+}
+
+void handle_signals() {
+    struct signalfd_siginfo si;
+
+    while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+        switch (si.ssi_signo) {
+            case SIGCHLD:
+                while (waitpid(-1, NULL, WNOHANG) > 0);
+                break;
+            case SIGUSR1:
+                dump_state();
+#ifdef STATS
+                dump_stats(stderr, False);
+#endif
+                break;
+#ifdef STATS
+            case SIGUSR2:
+                dump_stats(stderr, True);
+                break;
+#endif
+            case SIGHUP:
+                restarting = True;
+                running = False;
+                break;
+            case SIGTERM:
+            case SIGINT:
+                running = False;
+                break;
+        }
+    }
+}
+
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void schedule_timer(int timer, unsigned int ms) {
+    timer_deadlines[timer] = now_ms() + ms;
+}
+
+void cancel_timer(int timer) {
+    timer_deadlines[timer] = 0;
+}
+
+void arm_timer() {
+    struct itimerspec its = {0};
+    long long next = 0;
+
+    for (int i = 0; i < TIMER_LAST; i++)
+        if (timer_deadlines[i] && (!next || timer_deadlines[i] < next))
+            next = timer_deadlines[i];
+    if (next) {
+        long long delay = next - now_ms();
+        if (delay < 1)
+            delay = 1;
+        its.it_value.tv_sec = delay / 1000;
+        its.it_value.tv_nsec = (delay % 1000) * 1000000;
+    }
+    timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+void flush_pending() {
+    if (monitors_dirty)
+        update_monitors();
+    unsigned int retiled = flush_layout();
+    flush_ewmh();
+    if (enter_serial == NextRequest(dpy))
+        XNoOp(dpy);
+    if (retiled && SYNC_TILE_WAIT > 0)
+        wait_for_sync(retiled, SYNC_TILE_WAIT);
+}
+
+void run_timers() {
+    long long now = now_ms();
+
+    for (int i = 0; i < TIMER_LAST; i++) {
+        if (timer_deadlines[i] && timer_deadlines[i] <= now) {
+            trace_record(TRACE_TIMER, i, NULL);
+            fire_timer(i);
+        }
+    }
+}
+
+void fire_timer(int timer) {
+    timer_deadlines[timer] = 0;
+    timer_funcs[timer]();
+}
+
+void setup_trace() {
+    const char *path = getenv("RUDE_TRACE");
+    TraceHeader header = {
+        TRACE_MAGIC,
+        DisplayWidth(dpy, screen),
+        DisplayHeight(dpy, screen),
+        root,
+        numlockmask,
+        LENGTH(keys)
+    };
+
+    if (!path || !*path)
+        return;
+    trace_file = fopen(path, "wb");
+    if (!trace_file) {
+        perror("rude: trace");
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, trace_file);
+    for (unsigned int i = 0; i < LENGTH(keys); i++) {
+        TraceRecord record = { TRACE_KEYCODE, XKeysymToKeycode(dpy, keys[i].keysym), keys[i].keysym };
+        fwrite(&record, sizeof(record), 1, trace_file);
+    }
+}
+
+void trace_data(unsigned int kind, unsigned int value, const void *data, size_t size) {
+    struct timespec ts;
+
+    if (!trace_file)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    TraceRecord record = { kind, value, ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 };
+    fwrite(&record, sizeof(record), 1, trace_file);
+    if (size)
+        fwrite(data, 1, size, trace_file);
+}
+
+void trace_record(unsigned int kind, unsigned int value, XEvent *ev) {
+    trace_data(kind, value, ev, ev ? sizeof(XEvent) : 0);
+}
+
+#ifndef RUDE_REPLAY
+void trace_fetch(unsigned int kind, Window w, WindowInfo *info) {
+    TraceFetch fetch = { w, *info };
+    trace_data(TRACE_FETCH, kind, &fetch, sizeof(fetch));
+}
+#endif
+
+Bool check_typed_event(int type, XEvent *ev) {
+    if (!XCheckTypedEvent(dpy, type, ev))
+        return False;
+    trace_record(TRACE_CHECKED, 0, ev);
+    return True;
+}
+
+Bool check_next_event(int type, XEvent *ev) {
+    XEvent next;
+
+    if (!XEventsQueued(dpy, QueuedAfterReading))
+        return False;
+    XPeekEvent(dpy, &next);
+    if (next.type != type)
+        return False;
+    XNextEvent(dpy, ev);
+    trace_record(TRACE_CHECKED, 0, ev);
+    return True;
+}
+
+void dump_state() {
+    fprintf(stderr, "rude: desktop %u, %s mode\n", current_desktop + 1,
+            is_floating_mode ? "float" : "tile");
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        fprintf(stderr, "rude: desktop %d (monitor %d%s, %s, %.2f, %d):", i + 1, desktops[i].monitor + 1,
+                desktop_visible(i) ? ", visible" : "", layouts[desktops[i].layout].name,
+                desktops[i].master_ratio, desktops[i].master_count);
+        for (int j = 0; j < desktops[i].nclients; j++)
+            fprintf(stderr, " 0x%lx", desktops[i].clients[j]->window);
+        fprintf(stderr, "\n");
+    }
+}
+
+void setup_control() {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct epoll_event ev = { .events = EPOLLIN };
+    const char *path = getenv("RUDE_SOCKET");
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char display[64];
+    int n;
+
+    for (int i = 0; i < MAX_CONTROLS; i++)
+        controls[i].fd = -1;
+    snprintf(display, sizeof(display), "%s", DisplayString(dpy));
+    for (char *p = display; *p; p++)
+        if (*p == '/')
+            *p = '_';
+    if (path && *path)
+        n = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    else if (dir && *dir)
+        n = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/rude-%s.sock", dir, display);
+    else
+        n = snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/rude-%d-%s.sock", (int)getuid(), display);
+    if (n < 0 || n >= (int)sizeof(addr.sun_path)) {
+        fprintf(stderr, "rude: control socket path too long\n");
+        return;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        if (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0 || errno == EAGAIN) {
+            fprintf(stderr, "rude: %s is in use, control socket disabled\n", addr.sun_path);
+            close(probe);
+            return;
+        }
+        if (errno == ECONNREFUSED)
+            unlink(addr.sun_path);
+        close(probe);
+    }
+
+    control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ev.data.fd = control_fd;
+    if (control_fd < 0 || bind(control_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        chmod(addr.sun_path, 0600) < 0 || listen(control_fd, MAX_CONTROLS) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd, &ev) < 0) {
+        perror("rude: control socket");
+        if (control_fd >= 0)
+            close(control_fd);
+        control_fd = -1;
+        return;
+    }
+    strcpy(control_path, addr.sun_path);
+}
+
+void handle_control(int fd) {
+    struct epoll_event ev = { .events = EPOLLIN };
+    ControlClient *cc = NULL;
+    Bool eof = False;
+    char *reply = NULL;
+    size_t size = 0;
+    ssize_t n;
+
+    if (fd == control_fd) {
+        while ((fd = accept4(control_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            for (int i = 0; i < MAX_CONTROLS && !cc; i++)
+                if (controls[i].fd < 0)
+                    cc = &controls[i];
+            ev.data.fd = fd;
+            if (!cc || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+            cc->fd = fd;
+            cc->len = 0;
+            cc = NULL;
+        }
+        return;
+    }
+
+    for (int i = 0; i < MAX_CONTROLS && !cc; i++)
+        if (controls[i].fd == fd)
+            cc = &controls[i];
+    if (!cc)
+        return;
+
+    while (cc->len < CONTROL_BUFSIZE - 1) {
+        n = read(fd, cc->buf + cc->len, CONTROL_BUFSIZE - 1 - cc->len);
+        if (n > 0)
+            cc->len += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else {
+            eof = n == 0 || errno != EAGAIN;
+            break;
+        }
+    }
+
+    int end = cc->len;
+    if (!eof)
+        while (end > 0 && cc->buf[end - 1] != '\n' && cc->buf[end - 1] != ';')
+            end--;
+    if (end == 0 && cc->len == CONTROL_BUFSIZE - 1) {
+        dprintf(fd, "error: command too long\n");
+        close_control(cc);
+        return;
+    }
+    if (end > 0) {
+        FILE *f = open_memstream(&reply, &size);
+        if (f == NULL) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        char saved = cc->buf[end];
+        cc->buf[end] = '\0';
+        run_commands(cc->buf, f);
+        cc->buf[end] = saved;
+        fclose(f);
+        if (size)
+            send(fd, reply, size, MSG_NOSIGNAL);
+        free(reply);
+        memmove(cc->buf, cc->buf + end, cc->len - end);
+        cc->len -= end;
+    }
+    if (eof)
+        close_control(cc);
+}
+
+void close_control(ControlClient *cc) {
+    close(cc->fd);
+    cc->fd = -1;
+    cc->len = 0;
+}
+
+void run_commands(char *batch, FILE *reply) {
+    char *save, *cmd;
+    Bool query = False;
+
+    trace_data(TRACE_CONTROL, strlen(batch), batch, strlen(batch));
+
+    batching = True;
+    for (cmd = strtok_r(batch, ";\n", &save); cmd; cmd = strtok_r(NULL, ";\n", &save)) {
+        char *argv[3], *s;
+        int argc = 0;
+        unsigned int i;
+
+        for (char *t = strtok_r(cmd, " \t", &s); t && argc < 3; t = strtok_r(NULL, " \t", &s))
+            argv[argc++] = t;
+        if (argc == 0)
+            continue;
+        if (strcmp(argv[0], "query") == 0) {
+            query = True;
+            continue;
+        }
+        for (i = 0; i < LENGTH(commands); i++)
+            if (strcmp(argv[0], commands[i].name) == 0)
+                break;
+        if (i == LENGTH(commands))
+            fprintf(reply, "error: unknown command %s\n", argv[0]);
+        else if (!commands[i].func(argc, argv))
+            fprintf(reply, "error: bad arguments to %s\n", argv[0]);
+    }
+    batching = False;
+    flush_pending();
+    if (query)
+        write_state(reply);
+}
+
+void write_state(FILE *f) {
+    fprintf(f, "current %u %s 0x%lx\n", current_desktop + 1, is_floating_mode ? "float" : "tile", focused_window);
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        Desktop *d = &desktops[i];
+        fprintf(f, "desktop %d %d %d %s %.2f %d %d\n", i + 1, d->monitor + 1, desktop_visible(i),
+                layouts[d->layout].name, d->master_ratio, d->master_count, d->nclients);
+        for (int j = 0; j < d->nclients; j++) {
+            Client *c = d->clients[j];
+            fprintf(f, "client 0x%lx %d %d %d %d %d%s%s\n", c->window, i + 1,
+                    c->applied.x, c->applied.y, c->applied.width, c->applied.height,
+                    c->flags & CLIENT_FLOATING ? " floating" : "",
+                    c->flags & CLIENT_FULLSCREEN ? " fullscreen" : "");
+        }
+    }
+}
+
+Client *parse_client(const char *s) {
+    char *end;
+    unsigned long w = strtoul(s, &end, 0);
+
+    return *s && !*end ? find_client(w) : NULL;
+}
+
+Bool parse_desktop(const char *s, unsigned int *desktop) {
+    char *end;
+    unsigned long n = strtoul(s, &end, 10);
+
+    if (!*s || *end || n < 1 || n > NUM_DESKTOPS)
+        return False;
+    *desktop = n - 1;
+    return True;
+}
+
+Bool cmd_focus(int argc, char **argv) {
+    Desktop *d = &desktops[current_desktop];
+    Client *c;
+
+    if (argc < 2 || strcmp(argv[1], "next") == 0) {
+        focus_next(NULL);
+        return True;
+    }
+    if (strcmp(argv[1], "prev") == 0) {
+        if (d->nclients > 0)
+            focus_client((MAX(current_client, 0) + d->nclients - 1) % d->nclients);
+        return True;
+    }
+    if (!(c = parse_client(argv[1])))
+        return False;
+    if (!desktop_visible(c->desktop)) {
+        switch_desktop(c->desktop);
+    } else if (c->desktop != current_desktop) {
+        current_desktop = c->desktop;
+    }
+    focus_client(c->index);
+    return True;
+}
+
+Bool cmd_kill(int argc, char **argv) {
+    Client *c;
+
+    if (argc < 2) {
+        kill_focused(NULL);
+        return True;
+    }
+    if (!(c = parse_client(argv[1])))
+        return False;
+    kill_client(c->window);
+    return True;
+}
+
+Bool cmd_move(int argc, char **argv) {
+    Desktop *d = &desktops[current_desktop];
+    unsigned int desktop;
+    Client *c = NULL;
+
+    if (argc < 2 || !parse_desktop(argv[1], &desktop))
+        return False;
+    if (argc > 2)
+        c = parse_client(argv[2]);
+    else if (current_client >= 0 && current_client < d->nclients)
+        c = d->clients[current_client];
+    if (!c)
+        return False;
+    move_client(c, desktop);
+    return True;
+}
+
+Bool cmd_desktop(int argc, char **argv) {
+    unsigned int desktop;
+
+    if (argc < 2 || !parse_desktop(argv[1], &desktop))
+        return False;
+    switch_desktop(desktop);
+    return True;
+}
+
+Bool cmd_layout(int argc, char **argv) {
+    if (argc < 2)
+        return False;
+    for (unsigned int i = 0; i < LAYOUT_LAST; i++) {
+        if (strcmp(argv[1], layouts[i].name) == 0) {
+            set_layout(&(Arg){ .ui = i });
+            return True;
+        }
+    }
+    return False;
+}
+
+Bool cmd_float(int argc, char **argv) {
+    toggle_floating(NULL);
+    return True;
+}
+
+void dispatch_event(XEvent *e) {
+    switch (e->type) {
+        case KeyPress:
+            handle_keypress(e);
+            break;
+        case MappingNotify:
+            handle_mappingnotify(e);
+            break;
+        case MapRequest:
+            handle_maprequest(e);
+            break;
+        case UnmapNotify:
+            handle_unmapnotify(e);
+            break;
+        case DestroyNotify:
+            handle_destroynotify(e);
+            break;
+        case MapNotify:
+            handle_mapnotify(e);
+            break;
+        case ConfigureNotify:
+            handle_configurenotify(e);
+            break;
+        case PropertyNotify:
+            handle_propertynotify(e);
+            break;
+        case EnterNotify:
+            handle_enternotify(e);
+            break;
+        case FocusIn:
+        case FocusOut:
+            handle_focus(e);
+            break;
+        case ClientMessage:
+            handle_clientmessage(e);
+            break;
+        case ButtonPress:
+            handle_buttonpress(e);
+            break;
+        case ButtonRelease:
+            handle_buttonrelease(e);
+            break;
+        case MotionNotify:
+            handle_motionnotify(e);
+            break;
+        default:
+            if (have_sync && e->type == sync_event_base + XSyncAlarmNotify)
+                handle_syncalarm(e);
+#ifdef XRANDR
+            else if (have_randr && (e->type == randr_event_base + RRScreenChangeNotify ||
+                                    e->type == randr_event_base + RRNotify))
+                handle_screenchange(e);
+#endif
+            break;
+    }
+}
+
+unsigned int flush_layout() {
+    unsigned int retiled = 0;
+
+    if (is_floating_mode)
+        return 0;
+    for (int m = 0; m < nmonitors; m++) {
+        unsigned int desktop = monitors[m].desktop;
+        if (desktops[desktop].dirty) {
+            STAT_BEGIN(start);
+            tile_windows(desktop);
+            STAT_END(funcs[STAT_TILE], start);
+            desktops[desktop].dirty = False;
+            retiled |= 1 << desktop;
+        }
+    }
+    return retiled;
+}
+
+void flush_ewmh() {
+    if (client_list_dirty) {
+        update_client_list();
+        client_list_dirty = False;
+    }
+    update_active_window();
+    update_net_current_desktop();
+}
+
+void mark_layout_dirty(unsigned int desktop) {
+    desktops[desktop].dirty = True;
+}
+
+void mark_all_layouts_dirty() {
+    for (int i = 0; i < NUM_DESKTOPS; i++)
+        desktops[i].dirty = True;
+}
+
+void handle_keypress(XEvent *e) {
+    XKeyEvent *ev = &e->xkey;
+    unsigned int state = CLEANMASK(ev->state);
+
+    if (ev->keycode >= LENGTH(key_first))
+        return;
+    for (int i = key_first[ev->keycode]; i >= 0; i = key_next[i]) {
+        if (CLEANMASK(keys[i].mod) == state) {
+            keys[i].func(&keys[i].arg);
+            return;
+        }
+    }
+}
+
+void handle_mappingnotify(XEvent *e) {
+    XMappingEvent *ev = &e->xmapping;
+
+    XRefreshKeyboardMapping(ev);
+    if (ev->request == MappingKeyboard || ev->request == MappingModifier) {
+        grab_keys();
+        if (is_floating_mode) {
+            ungrab_buttons();
+            grab_buttons();
+        }
+    }
+}
+
+void update_numlockmask() {
+    STAT_INC(round_trips);
+    XModifierKeymap *modmap = XGetModifierMapping(dpy);
+    KeyCode numlock = XKeysymToKeycode(dpy, XK_Num_Lock);
+
+    numlockmask = 0;
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < modmap->max_keypermod; j++)
+            if (modmap->modifiermap[i * modmap->max_keypermod + j] == numlock)
+                numlockmask = (1 << i);
+    XFreeModifiermap(modmap);
+}
+
+void grab_keys() {
+    update_numlockmask();
+    unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask | LockMask };
+
+    XUngrabKey(dpy, AnyKey, AnyModifier, root);
+    for (unsigned int i = 0; i < LENGTH(key_first); i++)
+        key_first[i] = -1;
+    for (int i = LENGTH(keys) - 1; i >= 0; i--) {
+        KeyCode code = XKeysymToKeycode(dpy, keys[i].keysym);
+        if (!code)
+            continue;
+        key_next[i] = key_first[code];
+        key_first[code] = i;
+        for (unsigned int j = 0; j < LENGTH(modifiers); j++)
+            XGrabKey(dpy, code, keys[i].mod | modifiers[j], root, True, GrabModeAsync, GrabModeAsync);
+    }
+}
+
+void grab_buttons() {
+    unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask | LockMask };
+    unsigned int buttons[] = { Button1, Button3 };
+
+    for (unsigned int i = 0; i < LENGTH(buttons); i++)
+        for (unsigned int j = 0; j < LENGTH(modifiers); j++)
+            XGrabButton(dpy, buttons[i], MODKEY | modifiers[j], root, True,
+                        ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
+                        GrabModeAsync, GrabModeAsync, None, None);
+}
+
+void ungrab_buttons() {
+    XUngrabButton(dpy, Button1, AnyModifier, root);
+    XUngrabButton(dpy, Button3, AnyModifier, root);
+}
+
+void kill_focused(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+    if (d->nclients > 0 && current_client >= 0 && current_client < d->nclients)
+        kill_client(d->clients[current_client]->window);
+}
+
+void focus_next(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+    if (d->nclients > 0) {
+        current_client = (current_client + 1) % d->nclients;
+        focus_client(current_client);
+    }
+}
+
+void toggle_floating(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+
+    is_floating_mode = !is_floating_mode;
+    if (is_floating_mode) {
+        grab_buttons();
+
+        WindowGeometry g = desktop_monitor(current_desktop)->geom;
+        
+        for (int i = 0; i < d->nclients; i++) {
+            Client *c = d->clients[i];
+            if (c->flags & CLIENT_FULLSCREEN)
+                continue;
+            
+            if (c->applied.x <= -9000) {  
+                int offset = i * 30;
+                c->geom.x = g.x + (g.width / 4) + offset;
+                c->geom.y = g.y + (g.height / 4) + offset;
+                c->geom.width = (g.width * 2) / 3;
+                c->geom.height = (g.height * 2) / 3;
+            }
+            
+            configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+        }
+    } else {
+        ungrab_buttons();
+        mark_all_layouts_dirty();
+    }
+}
+
+void view_desktop(const Arg *arg) {
+    switch_desktop(arg->ui);
+}
+
+void set_layout(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+
+    if (arg->ui >= LAYOUT_LAST || d->layout == arg->ui)
+        return;
+    d->layout = arg->ui;
+    mark_layout_dirty(current_desktop);
+}
+
+void adjust_master_ratio(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+    float ratio = d->master_ratio + arg->f;
+
+    if (ratio < 0.1 || ratio > 0.9)
+        return;
+    d->master_ratio = ratio;
+    mark_layout_dirty(current_desktop);
+}
+
+void adjust_master_count(const Arg *arg) {
+    Desktop *d = &desktops[current_desktop];
+    int count = d->master_count + arg->i;
+
+    if (count < 0)
+        return;
+    d->master_count = count;
+    mark_layout_dirty(current_desktop);
+}
+
+void handle_maprequest(XEvent *e) {
+    XMapRequestEvent *ev = &e->xmaprequest;
+    Client *c;
+
+    if ((c = find_client(ev->window))) {
+        if (desktop_visible(c->desktop))
+            XMapWindow(dpy, ev->window);
+        return;
+    }
+
+    if (fetch_pending(ev->window, 1 << FETCH_MAP))
+        return;
+
+    XSelectInput(dpy, ev->window, CLIENT_EVENT_MASK);
+    request_fetch(ev->window, FETCH_MAP);
+}
+
+void manage_window(Window w, WindowInfo *info) {
+    Client *c;
+
+    if (!info->valid || info->override_redirect || find_client(w))
+        return;
+
+    if (info->window_type == atoms[ATOM_NET_WM_WINDOW_TYPE_DOCK]) {
+        XSelectInput(dpy, w, PropertyChangeMask);
+        if (set_strut(w, info->has_strut, info->strut))
+            mark_all_layouts_dirty();
+        XMapWindow(dpy, w);
+        return;
+    }
+
+    c = add_client(w, info, current_desktop);
+    if (set_strut(w, info->has_strut, info->strut))
+        mark_all_layouts_dirty();
+    if (is_floating_mode) {
+        WindowGeometry g = desktop_monitor(c->desktop)->geom;
+        
+        if (c->flags & CLIENT_HINTS) {
+            if (c->hints.flags & PSize) {
+                c->geom.width = c->hints.width;
+                c->geom.height = c->hints.height;
+            }
+            if (c->hints.flags & PBaseSize) {
+                c->geom.width = c->hints.base_width;
+                c->geom.height = c->hints.base_height;
+            }
+        }
+        
+        if (c->geom.width < 100) c->geom.width = 800;
+        if (c->geom.height < 100) c->geom.height = 600;
+        
+        c->geom.x = g.x + (g.width - c->geom.width) / 2;
+        c->geom.y = g.y + (g.height - c->geom.height) / 2;
+    }
+
+    if (c->flags & CLIENT_FULLSCREEN) {
+        c->flags &= ~CLIENT_FULLSCREEN;
+        set_fullscreen(c, True);
+    } else if (c->flags & CLIENT_FLOATING) {
+        place_floating(c);
+        configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+    } else if (!is_floating_mode) {
+        configure_client(c, -10000, -10000, c->applied.width, c->applied.height);
+    } else {
+        configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+    }
+    
+    XMapWindow(dpy, w);
+    focus_client(c->index);
+}
+
+void handle_unmapnotify(XEvent *e) {
+    XUnmapEvent *ev = &e->xunmap;
+    if (ev->event == root || ev->window == root)
+        return;
+
+    cancel_fetches(ev->window, ~0u);
+    remove_client(ev->window);
+}
+
+void handle_destroynotify(XEvent *e) {
+    XDestroyWindowEvent *ev = &e->xdestroywindow;
+    cancel_fetches(ev->window, ~0u);
+    if (ev->event == root && remove_strut(ev->window)) {
+        mark_all_layouts_dirty();
+        return;
+    }
+    if (ev->event != root && ev->window != root)
+        remove_client(ev->window);
+}
+
+void handle_mapnotify(XEvent *e) {
+    XMapEvent *ev = &e->xmap;
+    if (ev->event != root || ev->window == root || find_client(ev->window))
+        return;
+
+    top_window = None;
+    XSelectInput(dpy, ev->window, PropertyChangeMask);
+    request_fetch(ev->window, FETCH_STRUT);
+}
+
+void handle_configurenotify(XEvent *e) {
+    XConfigureEvent *ev = &e->xconfigure;
+    if (ev->event != ev->window)
+        return;
+
+    Client *c = find_client(ev->window);
+    if (!c || ev->serial < c->configure_serial)
+        return;
+    c->applied = (WindowGeometry){ ev->x, ev->y, ev->width, ev->height };
+}
+
+void handle_propertynotify(XEvent *e) {
+    XPropertyEvent *ev = &e->xproperty;
+
+    if (ev->atom == atoms[ATOM_NET_WM_STRUT] || ev->atom == atoms[ATOM_NET_WM_STRUT_PARTIAL]) {
+        request_fetch(ev->window, FETCH_STRUT);
+    } else if (find_client(ev->window) || fetch_pending(ev->window, 1 << FETCH_MAP)) {
+        if (ev->atom == XA_WM_NORMAL_HINTS)
+            request_fetch(ev->window, FETCH_HINTS);
+        else if (ev->atom == atoms[ATOM_WM_PROTOCOLS])
+            request_fetch(ev->window, FETCH_PROTOCOLS);
+        else if (ev->atom == atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER])
+            request_fetch(ev->window, FETCH_COUNTER);
+    }
+}
+
+void handle_enternotify(XEvent *e) {
+    XCrossingEvent *ev = &e->xcrossing;
+    if (ev->mode != NotifyNormal || ev->detail == NotifyInferior || ev->serial < enter_serial)
+        return;
+
+    Client *c = find_client(ev->window);
+    if (!c || !desktop_visible(c->desktop))
+        return;
+
+    Client *f = find_client(focused_window);
+    if (f && (f->flags & CLIENT_FULLSCREEN) && f->desktop == c->desktop)
+        return;
+
+    if (c->desktop != current_desktop)
+        current_desktop = c->desktop;
+    focus_client(c->index);
+}
+
+void handle_focus(XEvent *e) {
+    XFocusChangeEvent *ev = &e->xfocus;
+    if (ev->mode == NotifyGrab || ev->mode == NotifyUngrab || ev->detail == NotifyInferior ||
+        ev->detail == NotifyPointer)
+        return;
+
+    if (ev->type == FocusIn && find_client(ev->window))
+        focused_window = ev->window;
+    else if (ev->type == FocusOut && ev->window == focused_window)
+        focused_window = None;
+}
+
+void handle_clientmessage(XEvent *e) {
+    XClientMessageEvent *ev = &e->xclient;
+    if (ev->message_type == atoms[ATOM_NET_CURRENT_DESKTOP]) {
+        if (ev->data.l[0] >= 0 && ev->data.l[0] < NUM_DESKTOPS) {
+            switch_desktop(ev->data.l[0]);
+        }
+    } else if (ev->message_type == atoms[ATOM_WM_PROTOCOLS]) {
+#ifdef STATS
+    } else if (ev->message_type == atoms[ATOM_RUDE_STATS]) {
+        publish_stats();
+#endif
+    } else if (ev->message_type == atoms[ATOM_NET_CLOSE_WINDOW]) {
+        kill_client(ev->window);
+    } else if (ev->message_type == atoms[ATOM_NET_WM_STATE]) {
+        Client *c = find_client(ev->window);
+        if (!c || ((Atom)ev->data.l[1] != atoms[ATOM_NET_WM_STATE_FULLSCREEN] &&
+                   (Atom)ev->data.l[2] != atoms[ATOM_NET_WM_STATE_FULLSCREEN]))
+            return;
+        if (ev->data.l[0] == 1)
+            set_fullscreen(c, True);
+        else if (ev->data.l[0] == 0)
+            set_fullscreen(c, False);
+        else if (ev->data.l[0] == 2)
+            set_fullscreen(c, !(c->flags & CLIENT_FULLSCREEN));
+    }
+}
+
+void handle_buttonpress(XEvent *e) {
+    XButtonEvent *ev = &e->xbutton;
+    if (!(ev->state & MODKEY))
+        return;
+
+    Client *c = find_client(ev->subwindow);
+    if (!c || (c->flags & CLIENT_FULLSCREEN))
+        return;
+
+    drag_geom = c->applied;
+    start = *ev;
+    motion_time = 0;
+    motion_pending = False;
+}
+
+void handle_buttonrelease(XEvent *e) {
+    if (!is_floating_mode || start.subwindow == None)
+        return;
+
+    if (motion_pending)
+        apply_drag(find_client(start.subwindow));
+    cancel_timer(TIMER_DRAG);
+    start.subwindow = None;
+    XUngrabPointer(dpy, CurrentTime);
+}
+
+void handle_motionnotify(XEvent *e) {
+    if (!is_floating_mode)
+        return;
+
+    while (check_next_event(MotionNotify, e));
+
+    if (!(e->xbutton.state & Button1Mask) && !(e->xbutton.state & Button3Mask))
+        return;
+
+    XMotionEvent *ev = &e->xmotion;
+    int xdiff = ev->x_root - start.x_root;
+    int ydiff = ev->y_root - start.y_root;
+
+    Client *c = find_client(start.subwindow);
+    if (!c)
+        return;
+
+    if (start.button == Button1) {
+        c->geom.x = drag_geom.x + xdiff;
+        c->geom.y = drag_geom.y + ydiff;
+    } else if (start.button == Button3) {
+        c->geom.width = MAX(1, drag_geom.width + xdiff);
+        c->geom.height = MAX(1, drag_geom.height + ydiff);
+    } else {
+        return;
+    }
+
+    motion_pending = True;
+    if (ev->time - motion_time >= motion_interval) {
+        motion_time = ev->time;
+        apply_drag(c);
+        cancel_timer(TIMER_DRAG);
+    } else {
+        schedule_timer(TIMER_DRAG, motion_interval - (ev->time - motion_time));
+    }
+}
+
+void drag_timeout() {
+    if (motion_pending && start.subwindow != None)
+        apply_drag(find_client(start.subwindow));
+}
+
+void apply_drag(Client *c) {
+    if (!c)
+        return;
+    if (start.button == Button1)
+        configure_client(c, c->geom.x, c->geom.y, c->applied.width, c->applied.height);
+    else
+        configure_client(c, c->applied.x, c->applied.y, c->geom.width, c->geom.height);
+    motion_pending = False;
+}
+
+void tile_windows(unsigned int desktop) {
+    static WindowGeometry *layout = NULL;
+    static int capacity = 0;
+    Desktop *d = &desktops[desktop];
+    Client **clients = d->clients;
+    int nclients = 0;
+
+    if (is_floating_mode)
+        return;
+
+    for (int i = 0; i < d->nclients; i++) {
+        Client *c = clients[i];
+        if (c->flags & CLIENT_FULLSCREEN)
+            place_fullscreen(c);
+        else if (c->flags & CLIENT_FLOATING)
+            configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+        else
+            nclients++;
+    }
+    if (nclients == 0)
+        return;
+
+    if (nclients > capacity) {
+        WindowGeometry *new_layout = realloc(layout, sizeof(WindowGeometry) * d->capacity);
+        if (new_layout == NULL) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        layout = new_layout;
+        capacity = d->capacity;
+    }
+
+    if (struts_dirty)
+        update_workarea();
+
+    LayoutParams params = { d->master_ratio, d->master_count, GAP, 0 };
+    for (int i = 0; desktop == current_desktop && i < current_client && i < d->nclients; i++)
+        if (!(clients[i]->flags & (CLIENT_FULLSCREEN | CLIENT_FLOATING)))
+            params.focus++;
+    layouts[d->layout].arrange(desktop_monitor(desktop)->workarea, nclients, &params, layout);
+
+    for (int i = 0, slot = 0; i < d->nclients; i++) {
+        if (clients[i]->flags & (CLIENT_FULLSCREEN | CLIENT_FLOATING))
+            continue;
+        configure_client(clients[i], layout[slot].x, layout[slot].y, layout[slot].width, layout[slot].height);
+        slot++;
+    }
+}
+
+void configure_client(Client *c, int x, int y, int width, int height) {
+    XWindowChanges wc;
+    unsigned int mask = 0;
+
+    width = MAX(1, width);
+    height = MAX(1, height);
+    if (c->flags & CLIENT_SYNC_WAITING) {
+        if (width != c->applied.width || height != c->applied.height) {
+            c->sync_geom = (WindowGeometry){ x, y, width, height };
+            c->flags |= CLIENT_SYNC_PENDING;
+            return;
+        }
+        c->flags &= ~CLIENT_SYNC_PENDING;
+    }
+
+    if (x != c->applied.x) {
+        wc.x = c->applied.x = x;
+        mask |= CWX;
+    }
+    if (y != c->applied.y) {
+        wc.y = c->applied.y = y;
+        mask |= CWY;
+    }
+    if (width != c->applied.width) {
+        wc.width = c->applied.width = width;
+        mask |= CWWidth;
+    }
+    if (height != c->applied.height) {
+        wc.height = c->applied.height = height;
+        mask |= CWHeight;
+    }
+    if (mask) {
+        if (mask & (CWWidth | CWHeight))
+            send_sync_request(c);
+        c->configure_serial = NextRequest(dpy);
+        XConfigureWindow(dpy, c->window, mask, &wc);
+        STAT_INC(configures);
+        enter_serial = NextRequest(dpy);
+    }
+}
+
+void set_fullscreen(Client *c, Bool fullscreen) {
+    if (fullscreen == ((c->flags & CLIENT_FULLSCREEN) != 0))
+        return;
+
+    if (fullscreen) {
+        c->flags |= CLIENT_FULLSCREEN;
+        XChangeProperty(dpy, c->window, atoms[ATOM_NET_WM_STATE], XA_ATOM, 32, PropModeReplace,
+                        (unsigned char *)&atoms[ATOM_NET_WM_STATE_FULLSCREEN], 1);
+        if (desktop_visible(c->desktop)) {
+            place_fullscreen(c);
+            XRaiseWindow(dpy, c->window);
+            top_window = c->window;
+            enter_serial = NextRequest(dpy);
+        }
+    } else {
+        c->flags &= ~CLIENT_FULLSCREEN;
+        XChangeProperty(dpy, c->window, atoms[ATOM_NET_WM_STATE], XA_ATOM, 32, PropModeReplace,
+                        (unsigned char *)NULL, 0);
+        if (desktop_visible(c->desktop) && (is_floating_mode || (c->flags & CLIENT_FLOATING)))
+            configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+    }
+    struts_dirty = True;
+    mark_layout_dirty(c->desktop);
+}
+
+void place_fullscreen(Client *c) {
+    WindowGeometry g = desktop_monitor(c->desktop)->geom;
+    configure_client(c, g.x, g.y, g.width, g.height);
+}
+
+Bool should_float(Client *c) {
+    Atom floating_types[] = {
+        atoms[ATOM_NET_WM_WINDOW_TYPE_DIALOG],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_UTILITY],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_SPLASH],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLBAR],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION]
+    };
+
+    if (c->transient_for != None)
+        return True;
+    for (unsigned int i = 0; i < LENGTH(floating_types); i++)
+        if (c->window_type == floating_types[i])
+            return True;
+    return (c->flags & CLIENT_HINTS) &&
+           (c->hints.flags & PMinSize) && (c->hints.flags & PMaxSize) &&
+           c->hints.min_width > 0 && c->hints.min_height > 0 &&
+           c->hints.min_width == c->hints.max_width &&
+           c->hints.min_height == c->hints.max_height;
+}
+
+void place_floating(Client *c) {
+    Client *parent = c->transient_for != None ? find_client(c->transient_for) : NULL;
+    WindowGeometry area, workarea;
+
+    if (struts_dirty)
+        update_workarea();
+    workarea = desktop_monitor(c->desktop)->workarea;
+    if (parent && parent->desktop == c->desktop && parent->applied.x > -9000)
+        area = parent->applied;
+    else
+        area = workarea;
+    c->geom.width = MIN(c->geom.width, workarea.width);
+    c->geom.height = MIN(c->geom.height, workarea.height);
+    c->geom.x = area.x + (area.width - c->geom.width) / 2;
+    c->geom.y = area.y + (area.height - c->geom.height) / 2;
+}
+
+void setup_sync() {
+    int error_base, major, minor;
+
+    have_sync = XSyncQueryExtension(dpy, &sync_event_base, &error_base) &&
+                XSyncInitialize(dpy, &major, &minor);
+}
+
+void update_sync_counter(Client *c, XSyncCounter counter, unsigned long long value) {
+    if (c->sync_alarm) {
+        XSyncDestroyAlarm(dpy, c->sync_alarm);
+        c->sync_alarm = None;
+    }
+    c->sync_counter = counter;
+    if (!have_sync || !counter)
+        return;
+
+    XSyncAlarmAttributes attr;
+
+    c->sync_value = value;
+    attr.trigger.counter = counter;
+    attr.trigger.value_type = XSyncAbsolute;
+    attr.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntsToValue(&attr.trigger.wait_value, c->sync_value & 0xffffffff, c->sync_value >> 32);
+    XSyncIntsToValue(&attr.delta, 1, 0);
+    attr.events = True;
+    c->sync_alarm = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType | XSyncCATestType |
+                                     XSyncCAValue | XSyncCADelta | XSyncCAEvents, &attr);
+}
+
+void send_sync_request(Client *c) {
+    if (!(c->flags & CLIENT_SYNC_REQUEST) || !c->sync_alarm)
+        return;
+
+    XSyncAlarmAttributes attr;
+    XEvent ev;
+
+    c->sync_value++;
+    XSyncIntsToValue(&attr.trigger.wait_value, c->sync_value & 0xffffffff, c->sync_value >> 32);
+    XSyncChangeAlarm(dpy, c->sync_alarm, XSyncCAValue, &attr);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = ClientMessage;
+    ev.xclient.window = c->window;
+    ev.xclient.message_type = atoms[ATOM_WM_PROTOCOLS];
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = atoms[ATOM_NET_WM_SYNC_REQUEST];
+    ev.xclient.data.l[1] = CurrentTime;
+    ev.xclient.data.l[2] = c->sync_value & 0xffffffff;
+    ev.xclient.data.l[3] = c->sync_value >> 32;
+    XSendEvent(dpy, c->window, False, NoEventMask, &ev);
+
+    c->flags |= CLIENT_SYNC_WAITING;
+    c->sync_deadline = now_ms() + SYNC_TIMEOUT;
+    if (!timer_deadlines[TIMER_SYNC])
+        schedule_timer(TIMER_SYNC, SYNC_TIMEOUT);
+}
+
+void finish_sync(Client *c) {
+    c->flags &= ~CLIENT_SYNC_WAITING;
+    if (c->flags & CLIENT_SYNC_PENDING) {
+        c->flags &= ~CLIENT_SYNC_PENDING;
+        configure_client(c, c->sync_geom.x, c->sync_geom.y, c->sync_geom.width, c->sync_geom.height);
+    }
+}
+
+void handle_syncalarm(XEvent *e) {
+    XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        for (int j = 0; j < desktops[i].nclients; j++) {
+            Client *c = desktops[i].clients[j];
+            if (c->sync_alarm == ev->alarm) {
+                if (c->flags & CLIENT_SYNC_WAITING)
+                    finish_sync(c);
+                return;
+            }
+        }
+    }
+}
+
+void sync_timeout() {
+    long long now = now_ms();
+    long long next = 0;
+
+    for (int i = 0; i < NUM_DESKTOPS; i++) {
+        for (int j = 0; j < desktops[i].nclients; j++) {
+            Client *c = desktops[i].clients[j];
+            if (!(c->flags & CLIENT_SYNC_WAITING))
+                continue;
+            if (c->sync_deadline <= now)
+                finish_sync(c);
+            if ((c->flags & CLIENT_SYNC_WAITING) && (!next || c->sync_deadline < next))
+                next = c->sync_deadline;
+        }
+    }
+    if (next)
+        schedule_timer(TIMER_SYNC, MAX(1, next - now));
+}
+
+void wait_for_sync(unsigned int retiled, unsigned int ms) {
+    long long deadline = now_ms() + ms;
+    XEvent ev;
+
+    for (;;) {
+        Bool waiting = False;
+        for (int d = 0; d < NUM_DESKTOPS && !waiting; d++) {
+            if (!(retiled & (1 << d)))
+                continue;
+            for (int i = 0; i < desktops[d].nclients && !waiting; i++)
+                waiting = (desktops[d].clients[i]->flags & CLIENT_SYNC_WAITING) != 0;
+        }
+        if (!waiting)
+            return;
+
+        if (check_typed_event(sync_event_base + XSyncAlarmNotify, &ev)) {
+            handle_syncalarm(&ev);
+            continue;
+        }
+
+        long long remaining = deadline - now_ms();
+        if (remaining <= 0)
+            return;
+        struct pollfd pfd = { ConnectionNumber(dpy), POLLIN, 0 };
+        XFlush(dpy);
+        if (poll(&pfd, 1, remaining) <= 0)
+            return;
+        XEventsQueued(dpy, QueuedAfterReading);
+    }
+}
+
+unsigned long long query_sync_value(Display *display, XSyncCounter counter) {
+    XSyncValue value;
+
+    if (!have_sync || !counter)
+        return 0;
+    STAT_ROUND_TRIP(display);
+    if (!XSyncQueryCounter(display, counter, &value))
+        return 0;
+    return ((unsigned long long)(unsigned int)XSyncValueHigh32(value) << 32) | XSyncValueLow32(value);
+}
+
+XSyncCounter fetch_sync_counter(Display *display, Window w, unsigned long long *value) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *data = NULL;
+    XSyncCounter counter = None;
+
+    STAT_ROUND_TRIP(display);
+    if (XGetWindowProperty(display, w, atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER], 0, 1, False, XA_CARDINAL,
+                           &actual_type, &actual_format, &nitems, &bytes_after, &data) == Success && data) {
+        if (actual_format == 32 && nitems == 1)
+            counter = ((unsigned long *)data)[0];
+        XFree(data);
+    }
+    *value = query_sync_value(display, counter);
+    return counter;
+}
+
+void switch_desktop(unsigned int desktop) {
+    if (desktop >= NUM_DESKTOPS || desktop == current_desktop)
+        return;
+
+    STAT_BEGIN(start);
+    Monitor *m = desktop_monitor(desktop);
+    Desktop *new = &desktops[desktop];
+
+    XGrabServer(dpy);
+    if (m->desktop != desktop) {
+        Desktop *old = &desktops[m->desktop];
+        for (int i = 0; i < old->nclients; i++) {
+            Client *c = old->clients[i];
+            configure_client(c, -10000, c->applied.y, c->applied.width, c->applied.height);
+        }
+
+        m->desktop = desktop;
+        if (is_floating_mode) {
+            for (int i = 0; i < new->nclients; i++) {
+                Client *c = new->clients[i];
+                if (c->flags & CLIENT_FULLSCREEN)
+                    place_fullscreen(c);
+                else
+                    configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
+            }
+        } else {
+            mark_layout_dirty(desktop);
+        }
+    }
+
+    current_desktop = desktop;
+    
+    if (new->nclients > 0) {
+        current_client = 0;
+        focus_client(current_client);
+    } else {
+        current_client = -1;
+        focused_window = None;
+        XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
+    }
+    unsigned int retiled = batching ? 0 : flush_layout();
+    XUngrabServer(dpy);
+    if (retiled && SYNC_TILE_WAIT > 0)
+        wait_for_sync(retiled, SYNC_TILE_WAIT);
+    STAT_END(funcs[STAT_SWITCH], start);
+}
+
+Client *alloc_client() {
+    if (!client_pool) {
+        Client *slab = calloc(CLIENT_SLAB, sizeof(Client));
+        if (!slab) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        for (int i = 0; i < CLIENT_SLAB; i++) {
+            slab[i].next_free = client_pool;
+            client_pool = &slab[i];
+        }
+    }
 
-    if (XGetWindowProperty(dpy, w, net_wm_strut_partial, 0, 12, False, XA_CARDINAL,
-                          &actual_type, &actual_format, &nitems, &bytes_after,
-                          (unsigned char **)&data) == Success && data) {
-        memcpy(strut, data, 12 * sizeof(unsigned long));
-        XFree(data);
+    Client *c = client_pool;
+    client_pool = c->next_free;
+    memset(c, 0, sizeof(Client));
+    return c;
+}
+
+void free_client(Client *c) {
+    c->window = None;
+    c->next_free = client_pool;
+    client_pool = c;
+}
+
+static unsigned int hash_window(Window w) {
+    return (unsigned int)((w * 0x9E3779B97F4A7C15ULL) >> 32) & (client_table_size - 1);
+}
+
+Client *find_client(Window w) {
+    if (client_table_count == 0)
+        return NULL;
+    for (unsigned int i = hash_window(w); client_table[i]; i = (i + 1) & (client_table_size - 1)) {
+        if (client_table[i]->window == w)
+            return client_table[i];
     }
+    return NULL;
 }
 
-int main() {
-    dpy = XOpenDisplay(NULL);
-    if (!dpy) {
-        fprintf(stderr, "rude: cannot open display\n");
-        exit(1);
+void index_insert(Client *c) {
+    if ((client_table_count + 1) * 2 > client_table_size) {
+        Client **old_table = client_table;
+        unsigned int old_size = client_table_size;
+
+        client_table_size = old_size ? old_size * 2 : 64;
+        client_table = calloc(client_table_size, sizeof(Client *));
+        if (!client_table) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        client_table_count = 0;
+        for (unsigned int i = 0; i < old_size; i++)
+            if (old_table[i])
+                index_insert(old_table[i]);
+        free(old_table);
     }
-    setup();
-    run();
-    XCloseDisplay(dpy);
-    return 0;
+
+    unsigned int i = hash_window(c->window);
+    while (client_table[i])
+        i = (i + 1) & (client_table_size - 1);
+    client_table[i] = c;
+    client_table_count++;
 }
 
-void setup() {
-    screen = DefaultScreen(dpy);
-    root = RootWindow(dpy, screen);
-    XSetErrorHandler(xerror);
-    XSelectInput(dpy, root, SubstructureRedirectMask | SubstructureNotifyMask | PointerMotionMask | EnterWindowMask);
-    
-    desktop_clients = calloc(NUM_DESKTOPS, sizeof(Window *));
-    desktop_nclients = calloc(NUM_DESKTOPS, sizeof(int));
-    if (!desktop_clients || !desktop_nclients) {
-        fprintf(stderr, "rude: failed to allocate memory\n");
-        exit(1);
+void index_remove(Window w) {
+    unsigned int mask = client_table_size - 1;
+    unsigned int i, j;
+
+    if (client_table_count == 0)
+        return;
+    for (i = hash_window(w); client_table[i]; i = (i + 1) & mask)
+        if (client_table[i]->window == w)
+            break;
+    if (!client_table[i])
+        return;
+
+    client_table[i] = NULL;
+    client_table_count--;
+    for (j = (i + 1) & mask; client_table[j]; j = (j + 1) & mask) {
+        unsigned int home = hash_window(client_table[j]->window);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            client_table[i] = client_table[j];
+            client_table[j] = NULL;
+            i = j;
+        }
     }
+}
 
-    XGrabKey(dpy, XKeysymToKeycode(dpy, XStringToKeysym("q")), MODKEY, root, True, GrabModeAsync, GrabModeAsync);
-    XGrabKey(dpy, XKeysymToKeycode(dpy, XStringToKeysym("Tab")), MODKEY, root, True, GrabModeAsync, GrabModeAsync);
-    XGrabKey(dpy, XKeysymToKeycode(dpy, XStringToKeysym("space")), MODKEY, root, True, GrabModeAsync, GrabModeAsync);
-    
-    for (int i = 1; i <= NUM_DESKTOPS; i++) {
-        char num[2] = { i + '0', '\0' };
-        XGrabKey(dpy, XKeysymToKeycode(dpy, XStringToKeysym(num)), MODKEY, root, True, GrabModeAsync, GrabModeAsync);
+static void reserve_client(Desktop *d) {
+    if (d->nclients == d->capacity) {
+        int capacity = d->capacity ? d->capacity * 2 : 8;
+        Client **new_clients = realloc(d->clients, sizeof(Client *) * capacity);
+        if (new_clients == NULL) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        d->clients = new_clients;
+        d->capacity = capacity;
     }
+}
+
+Client *add_client(Window w, WindowInfo *info, unsigned int desktop) {
+    Desktop *d = &desktops[desktop];
+
+    reserve_client(d);
+    Client *c = alloc_client();
+    c->window = w;
+    c->desktop = desktop;
+    c->index = d->nclients;
+    c->geom = info->geom;
+    c->applied = info->geom;
+    c->hints = info->hints;
+    c->flags = info->flags;
+    c->window_type = info->window_type;
+    c->transient_for = info->transient_for;
+    update_sync_counter(c, info->sync_counter, info->sync_value);
+    if (should_float(c))
+        c->flags |= CLIENT_FLOATING;
+
+    index_insert(c);
+    d->clients[d->nclients++] = c;
+    if (!(c->flags & CLIENT_FLOATING))
+        mark_layout_dirty(desktop);
+    client_list_dirty = True;
     
-    setup_ewmh();
-    update_net_number_of_desktops();
-    update_net_current_desktop();
+    update_net_desktop_for_window(w, desktop);
+    return c;
 }
 
-void run() {
-    XEvent ev;
-    while (!XNextEvent(dpy, &ev)) {
-        switch (ev.type) {
-            case KeyPress:
-                handle_keypress(&ev);
-                break;
-            case MapRequest:
-                handle_maprequest(&ev);
-                break;
-            case UnmapNotify:
-                handle_unmapnotify(&ev);
-                break;
-            case DestroyNotify:
-                handle_destroynotify(&ev);
-                break;
-            case EnterNotify:
-                handle_enternotify(&ev);
-                break;
-            case ClientMessage:
-                handle_clientmessage(&ev);
-                break;
-            case ButtonPress:
-                handle_buttonpress(&ev);
-                break;
-            case ButtonRelease:
-                handle_buttonrelease(&ev);
-                break;
-            case MotionNotify:
-                handle_motionnotify(&ev);
-                break;
-        }
+#ifdef XCB
+static xcb_get_property_reply_t *property_reply(xcb_connection_t *xc, xcb_get_property_cookie_t cookie,
+                                                 int format, int min_items) {
+    xcb_get_property_reply_t *r = xcb_get_property_reply(xc, cookie, NULL);
+    if (r && (r->format != format || xcb_get_property_value_length(r) < min_items * (format / 8))) {
+        free(r);
+        r = NULL;
     }
+    return r;
 }
 
-void handle_keypress(XEvent *e) {
-    XKeyEvent *ev = &e->xkey;
-    KeySym keysym = XLookupKeysym(ev, 0);
-    if (ev->state & MODKEY) {
-        if (keysym == XStringToKeysym("q")) {
-            if (nclients > 0 && current_client >= 0 && current_client < nclients) {
-                kill_client(clients[current_client]);
-            }
-        } else if (keysym == XStringToKeysym("Tab")) {
-            if (nclients > 0) {
-                current_client = (current_client + 1) % nclients;
-                focus_client(current_client);
-            }
-        } else if (keysym == XStringToKeysym("space")) {
-            is_floating_mode = !is_floating_mode;
-            if (is_floating_mode) {
-                XGrabButton(dpy, Button1, MODKEY, root, True,
-                            ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
-                            GrabModeAsync, GrabModeAsync, None, None);
-                XGrabButton(dpy, Button3, MODKEY, root, True,
-                            ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
-                            GrabModeAsync, GrabModeAsync, None, None);
-
-                int sw = DisplayWidth(dpy, screen);
-                int sh = DisplayHeight(dpy, screen);
-                
-                for (int i = 0; i < nclients; i++) {
-                    XWindowAttributes wa;
-                    XGetWindowAttributes(dpy, clients[i], &wa);
-                    
-                    if (wa.x <= -9000) {  
-                        int offset = i * 30;
-                        window_geometries[i].x = (sw / 4) + offset;
-                        window_geometries[i].y = (sh / 4) + offset;
-                        window_geometries[i].width = (sw * 2) / 3;
-                        window_geometries[i].height = (sh * 2) / 3;
-                    }
-                    
-                    XMoveResizeWindow(dpy, clients[i],
-                                    window_geometries[i].x,
-                                    window_geometries[i].y,
-                                    window_geometries[i].width,
-                                    window_geometries[i].height);
-                }
-            } else {
-                XUngrabButton(dpy, Button1, MODKEY, root);
-                XUngrabButton(dpy, Button3, MODKEY, root);
-                tile_windows();
-            }
+void fetch_window_info(Display *display, Window w, WindowInfo *info) {
+    xcb_connection_t *xc = XGetXCBConnection(display);
+    enum { P_HINTS, P_PROTOCOLS, P_TYPE, P_STATE, P_STRUT_PARTIAL, P_STRUT, P_TRANSIENT, P_COUNTER, P_LAST };
+    xcb_get_property_cookie_t pc[P_LAST];
+
+    memset(info, 0, sizeof(WindowInfo));
+    xcb_get_window_attributes_cookie_t ac = xcb_get_window_attributes(xc, w);
+    xcb_get_geometry_cookie_t gc = xcb_get_geometry(xc, w);
+    pc[P_HINTS] = xcb_get_property(xc, 0, w, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 0, 18);
+    pc[P_PROTOCOLS] = xcb_get_property(xc, 0, w, atoms[ATOM_WM_PROTOCOLS], XA_ATOM, 0, 32);
+    pc[P_TYPE] = xcb_get_property(xc, 0, w, atoms[ATOM_NET_WM_WINDOW_TYPE], XA_ATOM, 0, 32);
+    pc[P_STATE] = xcb_get_property(xc, 0, w, atoms[ATOM_NET_WM_STATE], XA_ATOM, 0, 32);
+    pc[P_STRUT_PARTIAL] = xcb_get_property(xc, 0, w, atoms[ATOM_NET_WM_STRUT_PARTIAL], XA_CARDINAL, 0, 12);
+    pc[P_STRUT] = xcb_get_property(xc, 0, w, atoms[ATOM_NET_WM_STRUT], XA_CARDINAL, 0, 4);
+    pc[P_TRANSIENT] = xcb_get_property(xc, 0, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+    pc[P_COUNTER] = xcb_get_property(xc, 0, w, atoms[ATOM_NET_WM_SYNC_REQUEST_COUNTER], XA_CARDINAL, 0, 1);
+    xcb_flush(xc);
+
+    STAT_ROUND_TRIP(display);
+    xcb_get_window_attributes_reply_t *ar = xcb_get_window_attributes_reply(xc, ac, NULL);
+    xcb_get_geometry_reply_t *gr = xcb_get_geometry_reply(xc, gc, NULL);
+    if (ar && gr) {
+        info->valid = True;
+        info->override_redirect = ar->override_redirect;
+        info->map_state = ar->map_state;
+        info->geom = (WindowGeometry){ gr->x, gr->y, gr->width, gr->height };
+    }
+    free(ar);
+    free(gr);
+
+    xcb_get_property_reply_t *r;
+    if ((r = property_reply(xc, pc[P_HINTS], 32, 15))) {
+        int32_t *v = xcb_get_property_value(r);
+        int n = xcb_get_property_value_length(r) / 4;
+        info->hints.flags = v[0];
+        info->hints.x = v[1];
+        info->hints.y = v[2];
+        info->hints.width = v[3];
+        info->hints.height = v[4];
+        info->hints.min_width = v[5];
+        info->hints.min_height = v[6];
+        info->hints.max_width = v[7];
+        info->hints.max_height = v[8];
+        info->hints.width_inc = v[9];
+        info->hints.height_inc = v[10];
+        info->hints.min_aspect.x = v[11];
+        info->hints.min_aspect.y = v[12];
+        info->hints.max_aspect.x = v[13];
+        info->hints.max_aspect.y = v[14];
+        if (n >= 18) {
+            info->hints.base_width = v[15];
+            info->hints.base_height = v[16];
+            info->hints.win_gravity = v[17];
+        } else {
+            info->hints.flags &= ~(PBaseSize | PWinGravity);
         }
-        for (int i = 1; i <= NUM_DESKTOPS; i++) {
-            char num[2] = { i + '0', '\0' };
-            if (keysym == XStringToKeysym(num)) {
-                switch_desktop(i - 1);
-                break;
-            }
+        info->flags |= CLIENT_HINTS;
+    }
+    free(r);
+    if ((r = property_reply(xc, pc[P_PROTOCOLS], 32, 1))) {
+        xcb_atom_t *v = xcb_get_property_value(r);
+        for (int i = 0; i < xcb_get_property_value_length(r) / 4; i++) {
+            if (v[i] == atoms[ATOM_WM_DELETE_WINDOW])
+                info->flags |= CLIENT_DELETE_WINDOW;
+            else if (v[i] == atoms[ATOM_NET_WM_SYNC_REQUEST])
+                info->flags |= CLIENT_SYNC_REQUEST;
         }
     }
+    free(r);
+    if ((r = property_reply(xc, pc[P_TYPE], 32, 1)))
+        info->window_type = *(xcb_atom_t *)xcb_get_property_value(r);
+    free(r);
+    if ((r = property_reply(xc, pc[P_STATE], 32, 1))) {
+        xcb_atom_t *v = xcb_get_property_value(r);
+        for (int i = 0; i < xcb_get_property_value_length(r) / 4; i++)
+            if (v[i] == atoms[ATOM_NET_WM_STATE_FULLSCREEN])
+                info->flags |= CLIENT_FULLSCREEN;
+    }
+    free(r);
+    for (int p = P_STRUT_PARTIAL; p <= P_STRUT; p++) {
+        if (info->has_strut) {
+            xcb_discard_reply(xc, pc[p].sequence);
+        } else if ((r = property_reply(xc, pc[p], 32, 4))) {
+            uint32_t *v = xcb_get_property_value(r);
+            int n = xcb_get_property_value_length(r) / 4;
+            for (int i = 0; i < n && i < 12; i++)
+                info->strut[i] = v[i];
+            info->has_strut = True;
+            free(r);
+        }
+    }
+    if ((r = property_reply(xc, pc[P_TRANSIENT], 32, 1)))
+        info->transient_for = *(xcb_window_t *)xcb_get_property_value(r);
+    free(r);
+    if ((r = property_reply(xc, pc[P_COUNTER], 32, 1)))
+        info->sync_counter = *(uint32_t *)xcb_get_property_value(r);
+    free(r);
+    info->sync_value = query_sync_value(display, info->sync_counter);
 }
+#else
+static int get_atom_list(Display *display, Window w, Atom prop, Atom *list, int max) {
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *data = NULL;
+    int n = 0;
 
-void handle_maprequest(XEvent *e) {
-    XMapRequestEvent *ev = &e->xmaprequest;
+    STAT_ROUND_TRIP(display);
+    if (XGetWindowProperty(display, w, prop, 0, max, False, XA_ATOM, &actual_type, &actual_format,
+                           &nitems, &bytes_after, &data) == Success && data) {
+        if (actual_format == 32)
+            for (n = 0; n < (int)nitems && n < max; n++)
+                list[n] = ((Atom *)data)[n];
+        XFree(data);
+    }
+    return n;
+}
+
+void fetch_window_info(Display *display, Window w, WindowInfo *info) {
     XWindowAttributes wa;
-    XSizeHints hints;
+    Atom list[32];
     long supplied;
+    int n;
 
-    XGetWindowAttributes(dpy, ev->window, &wa);
-    if (wa.override_redirect)
+    memset(info, 0, sizeof(WindowInfo));
+    STAT_ROUND_TRIP(display);
+    if (!XGetWindowAttributes(display, w, &wa))
         return;
-    
-    if (!is_floating_mode) {
-        XMoveWindow(dpy, ev->window, -10000, -10000);
-    } else {
-        int sw = DisplayWidth(dpy, screen);
-        int sh = DisplayHeight(dpy, screen);
-        
-        if (XGetWMNormalHints(dpy, ev->window, &hints, &supplied)) {
-            if (hints.flags & PSize) {
-                wa.width = hints.width;
-                wa.height = hints.height;
-            }
-            if (hints.flags & PBaseSize) {
-                wa.width = hints.base_width;
-                wa.height = hints.base_height;
-            }
+    info->valid = True;
+    info->override_redirect = wa.override_redirect;
+    info->map_state = wa.map_state;
+    info->geom = (WindowGeometry){ wa.x, wa.y, wa.width, wa.height };
+    if (info->override_redirect)
+        return;
+
+    STAT_ROUND_TRIP(display);
+    if (XGetWMNormalHints(display, w, &info->hints, &supplied))
+        info->flags |= CLIENT_HINTS;
+    info->flags |= fetch_protocols(display, w);
+    if (get_atom_list(display, w, atoms[ATOM_NET_WM_WINDOW_TYPE], list, 1))
+        info->window_type = list[0];
+    n = get_atom_list(display, w, atoms[ATOM_NET_WM_STATE], list, 32);
+    for (int i = 0; i < n; i++)
+        if (list[i] == atoms[ATOM_NET_WM_STATE_FULLSCREEN])
+            info->flags |= CLIENT_FULLSCREEN;
+    info->has_strut = get_strut_partial(display, w, info->strut);
+    STAT_ROUND_TRIP(display);
+    XGetTransientForHint(display, w, &info->transient_for);
+    if (info->flags & CLIENT_SYNC_REQUEST)
+        info->sync_counter = fetch_sync_counter(display, w, &info->sync_value);
+}
+#endif
+
+unsigned int fetch_protocols(Display *display, Window w) {
+    Atom *protocols = NULL;
+    unsigned int flags = 0;
+    int n = 0;
+
+    STAT_ROUND_TRIP(display);
+    if (XGetWMProtocols(display, w, &protocols, &n)) {
+        for (int i = 0; i < n; i++) {
+            if (protocols[i] == atoms[ATOM_WM_DELETE_WINDOW])
+                flags |= CLIENT_DELETE_WINDOW;
+            else if (protocols[i] == atoms[ATOM_NET_WM_SYNC_REQUEST])
+                flags |= CLIENT_SYNC_REQUEST;
         }
-        
-        if (wa.width < 100) wa.width = 800;
-        if (wa.height < 100) wa.height = 600;
-        
-        wa.x = (sw - wa.width) / 2;
-        wa.y = (sh - wa.height) / 2;
-        
-        XMoveResizeWindow(dpy, ev->window, wa.x, wa.y, wa.width, wa.height);
-    }
-    
-    add_client(ev->window);
-    XMapWindow(dpy, ev->window);
-    
-    if (!is_floating_mode) {
-        tile_windows();
+        XFree(protocols);
     }
-    focus_client(nclients - 1);
+    return flags;
 }
 
-void handle_unmapnotify(XEvent *e) {
-    XUnmapEvent *ev = &e->xunmap;
-    if (ev->event == root || ev->window == root)
-        return;
-        
-    remove_client(ev->window);
-    if (!is_floating_mode) {
-        tile_windows();
-    }
+static Bool queue_push(FetchQueue *q, Fetch *f) {
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) == FETCH_QUEUE_SIZE)
+        return False;
+    q->items[tail % FETCH_QUEUE_SIZE] = *f;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return True;
 }
 
-void handle_destroynotify(XEvent *e) {
-    XDestroyWindowEvent *ev = &e->xdestroywindow;
-    if (ev->event != root && ev->window != root) {
-        remove_client(ev->window);
-        tile_windows();
-    }
+static Bool queue_pop(FetchQueue *q, Fetch *f) {
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+        return False;
+    *f = q->items[head % FETCH_QUEUE_SIZE];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return True;
 }
 
-void handle_enternotify(XEvent *e) {
-    XCrossingEvent *ev = &e->xcrossing;
-    for (int i = 0; i < nclients; i++) {
-        if (clients[i] == ev->window) {
-            focus_client(i);
+static void *fetcher_main(void *arg) {
+    unsigned long long n;
+    Fetch f;
+
+    while (!atomic_load(&fetcher_quit)) {
+        if (read(fetch_request_fd, &n, sizeof(n)) < 0 && errno != EINTR)
             break;
+        while (!atomic_load(&fetcher_quit) && queue_pop(&fetch_requests, &f)) {
+            run_fetch(worker_dpy, &f);
+            while (!queue_push(&fetch_results, &f)) {
+                if (atomic_load(&fetcher_quit))
+                    return NULL;
+                usleep(1000);
+            }
+            n = 1;
+            write(fetch_result_fd, &n, sizeof(n));
         }
     }
+    return NULL;
 }
 
-void handle_clientmessage(XEvent *e) {
-    XClientMessageEvent *ev = &e->xclient;
-    if (ev->message_type == XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False)) {
-        if (ev->data.l[0] >= 0 && ev->data.l[0] < NUM_DESKTOPS) {
-            switch_desktop(ev->data.l[0]);
-        }
-    } else if (ev->message_type == XInternAtom(dpy, "WM_PROTOCOLS", True)) {
-    } else if (ev->message_type == XInternAtom(dpy, "_NET_CLOSE_WINDOW", False)) {
-        kill_client(ev->window);
-    }
-}
+void setup_fetcher() {
+    struct epoll_event ev = { .events = EPOLLIN };
+    int major, minor;
 
-void handle_buttonpress(XEvent *e) {
-    XButtonEvent *ev = &e->xbutton;
-    if (!(ev->state & MODKEY))
+    if (trace_file || !(worker_dpy = XOpenDisplay(DisplayString(dpy))))
         return;
-
-    Window w = ev->subwindow;
-    if (w == None)
+    if (have_sync)
+        XSyncInitialize(worker_dpy, &major, &minor);
+    fetch_request_fd = eventfd(0, EFD_CLOEXEC);
+    fetch_result_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.data.fd = fetch_result_fd;
+    if (fetch_request_fd >= 0 && fetch_result_fd >= 0 &&
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fetch_result_fd, &ev) == 0 &&
+        pthread_create(&fetcher, NULL, fetcher_main, NULL) == 0)
         return;
 
-    XGrabPointer(dpy, root, True,
-                 ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
-                 GrabModeAsync, GrabModeAsync,
-                 root, None, CurrentTime);
-
-    XGetWindowAttributes(dpy, w, &wa);
-    start = *ev;
+    perror("rude: fetcher");
+    if (fetch_request_fd >= 0)
+        close(fetch_request_fd);
+    if (fetch_result_fd >= 0)
+        close(fetch_result_fd);
+    fetch_request_fd = fetch_result_fd = -1;
+    XCloseDisplay(worker_dpy);
+    worker_dpy = NULL;
 }
 
-void handle_buttonrelease(XEvent *e) {
-    if (!is_floating_mode)
-        return;
-        
-    XButtonEvent *ev = &e->xbutton;
-    if (!(ev->state & MODKEY))
+void stop_fetcher() {
+    unsigned long long n = 1;
+
+    if (!worker_dpy)
         return;
+    atomic_store(&fetcher_quit, True);
+    write(fetch_request_fd, &n, sizeof(n));
+    pthread_join(fetcher, NULL);
+    XCloseDisplay(worker_dpy);
+    worker_dpy = NULL;
+    close(fetch_request_fd);
+    close(fetch_result_fd);
+    fetch_request_fd = fetch_result_fd = -1;
 
-    XUngrabPointer(dpy, CurrentTime);
+    for (int i = 0; i < nfetching; i++)
+        if (fetching[i].kind == FETCH_MAP)
+            XMapWindow(dpy, fetching[i].window);
+    nfetching = 0;
 }
 
-void handle_motionnotify(XEvent *e) {
-    if (!is_floating_mode)
-        return;
+void request_fetch(Window w, unsigned int kind) {
+    Fetch f = { .window = w, .kind = kind, .serial = ++fetch_serial };
+    unsigned long long n = 1;
 
-    if (!(e->xbutton.state & Button1Mask) && !(e->xbutton.state & Button3Mask))
+    if (worker_dpy && nfetching < FETCH_QUEUE_SIZE && queue_push(&fetch_requests, &f)) {
+        fetching[nfetching++] = (PendingFetch){ w, kind, f.serial };
+        XFlush(dpy);
+        write(fetch_request_fd, &n, sizeof(n));
         return;
+    }
+    cancel_fetches(w, 1 << kind);
+    run_fetch(dpy, &f);
+    apply_fetch(&f);
+}
 
-    XMotionEvent *ev = &e->xmotion;
-    int xdiff = ev->x_root - start.x_root;
-    int ydiff = ev->y_root - start.y_root;
+void run_fetch(Display *display, Fetch *f) {
+    long supplied;
 
-    for (int i = 0; i < nclients; i++) {
-        if (clients[i] == start.subwindow) {
-            if (start.button == Button1) {
-                window_geometries[i].x = wa.x + xdiff;
-                window_geometries[i].y = wa.y + ydiff;
-                XMoveWindow(dpy, start.subwindow,
-                           window_geometries[i].x,
-                           window_geometries[i].y);
-            } else if (start.button == Button3) {
-                window_geometries[i].width = MAX(1, wa.width + xdiff);
-                window_geometries[i].height = MAX(1, wa.height + ydiff);
-                XResizeWindow(dpy, start.subwindow,
-                            window_geometries[i].width,
-                            window_geometries[i].height);
-            }
+    memset(&f->info, 0, sizeof(WindowInfo));
+    switch (f->kind) {
+        case FETCH_MAP:
+            fetch_window_info(display, f->window, &f->info);
+            break;
+        case FETCH_HINTS:
+            STAT_ROUND_TRIP(display);
+            if (XGetWMNormalHints(display, f->window, &f->info.hints, &supplied))
+                f->info.flags |= CLIENT_HINTS;
+            break;
+        case FETCH_PROTOCOLS:
+            f->info.flags = fetch_protocols(display, f->window);
+            break;
+        case FETCH_COUNTER:
+            f->info.sync_counter = fetch_sync_counter(display, f->window, &f->info.sync_value);
+            break;
+        case FETCH_STRUT:
+            f->info.has_strut = get_strut_partial(display, f->window, f->info.strut);
             break;
-        }
     }
+    trace_fetch(f->kind, f->window, &f->info);
 }
 
-void tile_windows() {
-    if (nclients == 0 || is_floating_mode)
+void apply_fetch(Fetch *f) {
+    Client *c;
+
+    if (f->kind == FETCH_MAP) {
+        manage_window(f->window, &f->info);
+        return;
+    }
+    if (f->kind == FETCH_STRUT) {
+        if (set_strut(f->window, f->info.has_strut, f->info.strut))
+            mark_all_layouts_dirty();
+        return;
+    }
+    if (!(c = find_client(f->window)))
         return;
 
-    unsigned long strut[12] = {0};
-    int sw = DisplayWidth(dpy, screen);
-    int sh = DisplayHeight(dpy, screen);
-    int gap = GAP;
-    int total_gap = gap * 2;
-    
-    Window *windows = NULL;
-    unsigned int num_windows;
-    Window dummy1, dummy2;
-    
-    if (XQueryTree(dpy, root, &dummy1, &dummy2, &windows, &num_windows)) {
-        for (unsigned int i = 0; i < num_windows; i++) {
-            unsigned long window_strut[12] = {0};
-            get_strut_partial(windows[i], window_strut);
-            for (int j = 0; j < 12; j++) {
-                strut[j] = strut[j] > window_strut[j] ? strut[j] : window_strut[j];
-            }
-        }
-        XFree(windows);
+    switch (f->kind) {
+        case FETCH_HINTS:
+            c->flags = (c->flags & ~CLIENT_HINTS) | f->info.flags;
+            c->hints = f->info.hints;
+            break;
+        case FETCH_PROTOCOLS:
+            c->flags = (c->flags & ~(CLIENT_DELETE_WINDOW | CLIENT_SYNC_REQUEST)) | f->info.flags;
+            break;
+        case FETCH_COUNTER:
+            update_sync_counter(c, f->info.sync_counter, f->info.sync_value);
+            break;
     }
-    
-    int x = strut[0];
-    int y = strut[2];
-    sw -= (strut[0] + strut[1]);
-    sh -= (strut[2] + strut[3]);
-
-    if (nclients == 1) {
-        XMoveResizeWindow(dpy, clients[0],
-                         x + gap, y + gap,
-                         sw - total_gap - 2, sh - total_gap - 2);
-    } else {
-        int master_width = sw / 2;
-        XMoveResizeWindow(dpy, clients[0],
-                         x + gap, y + gap,
-                         master_width - total_gap - 2, sh - total_gap - 2);
-        int stack_count = nclients - 1;
-        int stack_width = sw - master_width;
-        int stack_height = (sh - total_gap - gap * (stack_count - 1)) / stack_count;
-        for (int i = 1; i < nclients; i++) {
-            XMoveResizeWindow(dpy, clients[i],
-                            x + master_width + gap,
-                            y + gap + (i - 1) * (stack_height + gap),
-                            stack_width - total_gap - 2,
-                            stack_height - 2);
+}
+
+void drain_fetches() {
+    unsigned long long n;
+    Fetch f;
+
+    while (read(fetch_result_fd, &n, sizeof(n)) > 0);
+    while (queue_pop(&fetch_results, &f)) {
+        for (int i = 0; i < nfetching; i++) {
+            if (fetching[i].serial == f.serial) {
+                fetching[i] = fetching[--nfetching];
+                apply_fetch(&f);
+                break;
+            }
         }
     }
 }
 
-void switch_desktop(unsigned int desktop) {
-    if (desktop >= NUM_DESKTOPS || desktop == current_desktop)
-        return;
-
-    desktop_clients[current_desktop] = clients;
-    desktop_nclients[current_desktop] = nclients;
+Bool fetch_pending(Window w, unsigned int kinds) {
+    for (int i = 0; i < nfetching; i++)
+        if (fetching[i].window == w && (kinds & (1 << fetching[i].kind)))
+            return True;
+    return False;
+}
 
-    Window *old_clients = clients;
-    int old_nclients = nclients;
+void cancel_fetches(Window w, unsigned int kinds) {
+    for (int i = 0; i < nfetching; i++)
+        if (fetching[i].window == w && (kinds & (1 << fetching[i].kind)))
+            fetching[i--] = fetching[--nfetching];
+}
 
-    clients = desktop_clients[desktop];
-    nclients = desktop_nclients[desktop];
-    current_desktop = desktop;
+void move_client(Client *c, unsigned int desktop) {
+    unsigned int old = c->desktop;
+    Desktop *from = &desktops[old];
+    Desktop *to = &desktops[desktop];
+    int i = c->index;
 
-    for (int i = 0; i < old_nclients; i++)
-        XUnmapWindow(dpy, old_clients[i]);
+    if (desktop == old)
+        return;
+    reserve_client(to);
+    memmove(&from->clients[i], &from->clients[i + 1], sizeof(Client *) * (from->nclients - i - 1));
+    from->nclients--;
+    for (int j = i; j < from->nclients; j++)
+        from->clients[j]->index = j;
+    c->desktop = desktop;
+    c->index = to->nclients;
+    to->clients[to->nclients++] = c;
+    if (!(c->flags & CLIENT_FLOATING)) {
+        mark_layout_dirty(old);
+        mark_layout_dirty(desktop);
+    }
+    update_net_desktop_for_window(c->window, desktop);
+    client_list_dirty = True;
 
-    for (int i = 0; i < nclients; i++)
-        XMapWindow(dpy, clients[i]);
+    if (!desktop_visible(desktop))
+        configure_client(c, -10000, c->applied.y, c->applied.width, c->applied.height);
+    else if (c->flags & CLIENT_FULLSCREEN)
+        place_fullscreen(c);
+    else if (is_floating_mode || (c->flags & CLIENT_FLOATING))
+        configure_client(c, c->geom.x, c->geom.y, c->geom.width, c->geom.height);
 
-    update_net_current_desktop();
-    tile_windows();
-    
-    if (nclients > 0) {
-        current_client = 0;
-        focus_client(current_client);
-    } else {
+    if (old != current_desktop || c->window != focused_window)
+        return;
+    if (from->nclients == 0) {
         current_client = -1;
+        focused_window = None;
         XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
+    } else {
+        if (current_client >= from->nclients)
+            current_client = from->nclients - 1;
+        focus_client(current_client);
     }
 }
 
-void add_client(Window w) {
-    Window *new_clients = realloc(clients, sizeof(Window) * (nclients + 1));
-    WindowGeometry *new_geometries = realloc(window_geometries, sizeof(WindowGeometry) * (nclients + 1));
-    
-    if (new_clients == NULL || new_geometries == NULL) {
-        fprintf(stderr, "rude: failed to allocate memory\n");
-        exit(1);
-    }
-    
-    clients = new_clients;
-    window_geometries = new_geometries;
-    desktop_clients[current_desktop] = clients;
-    
-    XWindowAttributes wa;
-    XGetWindowAttributes(dpy, w, &wa);
-    window_geometries[nclients].x = wa.x;
-    window_geometries[nclients].y = wa.y;
-    window_geometries[nclients].width = wa.width;
-    window_geometries[nclients].height = wa.height;
-    
-    clients[nclients++] = w;
-    desktop_nclients[current_desktop] = nclients;
-    
-    XSelectInput(dpy, w, StructureNotifyMask | EnterWindowMask | FocusChangeMask);
-    update_client_list(clients, nclients);
-    update_net_desktop_for_window(w);
-}
-
 void remove_client(Window w) {
-    for (int i = 0; i < nclients; i++) {
-        if (clients[i] == w) {
-            memmove(&clients[i], &clients[i + 1], sizeof(Window) * (nclients - i - 1));
-            memmove(&window_geometries[i], &window_geometries[i + 1], 
-                   sizeof(WindowGeometry) * (nclients - i - 1));
-            nclients--;
-            desktop_nclients[current_desktop] = nclients;
-            
-            if (nclients == 0) {
-                free(clients);
-                free(window_geometries);
-                clients = NULL;
-                window_geometries = NULL;
-                desktop_clients[current_desktop] = NULL;
-                current_client = -1;
-            } else {
-                Window *new_clients = realloc(clients, sizeof(Window) * nclients);
-                WindowGeometry *new_geometries = realloc(window_geometries, 
-                                                       sizeof(WindowGeometry) * nclients);
-                if (new_clients == NULL || new_geometries == NULL) {
-                    fprintf(stderr, "rude: failed to allocate memory\n");
-                    exit(1);
-                }
-                clients = new_clients;
-                window_geometries = new_geometries;
-                desktop_clients[current_desktop] = clients;
-                if (current_client >= nclients)
-                    current_client = nclients - 1;
-                focus_client(current_client);
-            }
-            break;
-        }
+    Client *c = find_client(w);
+    if (!c)
+        return;
+
+    unsigned int desktop = c->desktop;
+    Desktop *d = &desktops[desktop];
+    int i = c->index;
+    Bool floating = (c->flags & CLIENT_FLOATING) != 0;
+
+    index_remove(w);
+    if (c->sync_alarm)
+        XSyncDestroyAlarm(dpy, c->sync_alarm);
+    free_client(c);
+    if (w == focused_window)
+        focused_window = None;
+    if (w == top_window)
+        top_window = None;
+
+    memmove(&d->clients[i], &d->clients[i + 1], sizeof(Client *) * (d->nclients - i - 1));
+    d->nclients--;
+    for (int j = i; j < d->nclients; j++)
+        d->clients[j]->index = j;
+    if (!floating)
+        mark_layout_dirty(desktop);
+    client_list_dirty = True;
+
+    if (desktop != current_desktop)
+        return;
+
+    if (d->nclients == 0) {
+        current_client = -1;
+    } else {
+        if (current_client >= d->nclients)
+            current_client = d->nclients - 1;
+        focus_client(current_client);
     }
-    update_client_list(clients, nclients);
 }
 
 void focus_client(int index) {
-    if (index < 0 || index >= nclients)
+    Desktop *d = &desktops[current_desktop];
+    if (index < 0 || index >= d->nclients)
         return;
-    Window w = clients[index];
-    XSetInputFocus(dpy, w, RevertToPointerRoot, CurrentTime);
-    XRaiseWindow(dpy, w);
+    STAT_BEGIN(start);
+    Window w = d->clients[index]->window;
+    if (index != current_client && d->layout == LAYOUT_SCROLL)
+        mark_layout_dirty(current_desktop);
     current_client = index;
-    update_active_window(w);
+    if (w != top_window) {
+        XRaiseWindow(dpy, w);
+        top_window = w;
+        enter_serial = NextRequest(dpy);
+    }
+    if (w != focused_window) {
+        XSetInputFocus(dpy, w, RevertToPointerRoot, CurrentTime);
+        focused_window = w;
+    }
+    STAT_END(funcs[STAT_FOCUS], start);
 }
 
 void kill_client(Window w) {
-    Atom *protocols = NULL;
-    int n = 0;
-    Atom wm_delete = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
+    Client *c = find_client(w);
+    unsigned int flags = c ? c->flags : fetch_protocols(dpy, w);
 
-    if (XGetWMProtocols(dpy, w, &protocols, &n)) {
-        for (int i = 0; i < n; i++) {
-            if (protocols[i] == wm_delete) {
-                XEvent ev;
-                memset(&ev, 0, sizeof(ev));
-                ev.type = ClientMessage;
-                ev.xclient.window = w;
-                ev.xclient.message_type = XInternAtom(dpy, "WM_PROTOCOLS", True);
-                ev.xclient.format = 32;
-                ev.xclient.data.l[0] = wm_delete;
-                ev.xclient.data.l[1] = CurrentTime;
-                XSendEvent(dpy, w, False, NoEventMask, &ev);
-                XFree(protocols);
-                return;
-            }
-        }
-        XFree(protocols);
+    if (flags & CLIENT_DELETE_WINDOW) {
+        XEvent ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.type = ClientMessage;
+        ev.xclient.window = w;
+        ev.xclient.message_type = atoms[ATOM_WM_PROTOCOLS];
+        ev.xclient.format = 32;
+        ev.xclient.data.l[0] = atoms[ATOM_WM_DELETE_WINDOW];
+        ev.xclient.data.l[1] = CurrentTime;
+        XSendEvent(dpy, w, False, NoEventMask, &ev);
+        return;
     }
     XKillClient(dpy, w);
 }
 
+void setup_atoms() {
+    STAT_INC(round_trips);
+    if (!XInternAtoms(dpy, atom_names, ATOM_LAST, False, atoms)) {
+        fprintf(stderr, "rude: failed to intern atoms\n");
+        exit(1);
+    }
+    trace_data(TRACE_ATOMS, ATOM_LAST, atoms, sizeof(atoms));
+}
+
+void setup_motion_rate() {
+    int rate = MOTION_RATE;
+
+#ifdef XRANDR
+    if (rate == 0) {
+        STAT_INC(round_trips);
+        XRRScreenConfiguration *conf = XRRGetScreenInfo(dpy, root);
+        if (conf) {
+            rate = XRRConfigCurrentRate(conf);
+            XRRFreeScreenConfigInfo(conf);
+        }
+    }
+#endif
+    if (rate < 0)
+        motion_interval = 0;
+    else
+        motion_interval = 1000 / (rate > 0 ? rate : 60);
+}
+
 void setup_ewmh() {
-    Atom net_supported = XInternAtom(dpy, "_NET_SUPPORTED", False);
-    Atom net_wm_state = XInternAtom(dpy, "_NET_WM_STATE", False);
-    Atom net_wm_state_fullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
-    Atom net_active_window = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-    Atom net_wm_name = XInternAtom(dpy, "_NET_WM_NAME", False);
-    Atom net_supporting_wm_check = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
-    Atom net_client_list = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
-    Atom net_current_desktop = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
-    Atom net_number_of_desktops = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
-    Atom net_wm_desktop = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
-    
     Atom supported_atoms[] = {
-        net_supported,
-        net_wm_state,
-        net_wm_state_fullscreen,
-        net_active_window,
-        net_wm_name,
-        net_supporting_wm_check,
-        net_client_list,
-        net_current_desktop,
-        net_number_of_desktops,
-        net_wm_desktop
+        atoms[ATOM_NET_SUPPORTED],
+        atoms[ATOM_NET_WM_STATE],
+        atoms[ATOM_NET_WM_STATE_FULLSCREEN],
+        atoms[ATOM_NET_ACTIVE_WINDOW],
+        atoms[ATOM_NET_WM_NAME],
+        atoms[ATOM_NET_SUPPORTING_WM_CHECK],
+        atoms[ATOM_NET_CLIENT_LIST],
+        atoms[ATOM_NET_CURRENT_DESKTOP],
+        atoms[ATOM_NET_NUMBER_OF_DESKTOPS],
+        atoms[ATOM_NET_WM_DESKTOP],
+        atoms[ATOM_NET_WM_SYNC_REQUEST],
+        atoms[ATOM_NET_WM_WINDOW_TYPE],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_DOCK],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_DIALOG],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_UTILITY],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_SPLASH],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_TOOLBAR],
+        atoms[ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION]
     };
     
-    XChangeProperty(dpy, root, net_supported, XA_ATOM, 32, PropModeReplace, 
+    XChangeProperty(dpy, root, atoms[ATOM_NET_SUPPORTED], XA_ATOM, 32, PropModeReplace, 
                     (unsigned char *)supported_atoms, sizeof(supported_atoms)/sizeof(Atom));
 
     Window wm_window = XCreateSimpleWindow(dpy, root, -1, -1, 1, 1, 0, 0, 0);
-    XChangeProperty(dpy, root, net_supporting_wm_check, XA_WINDOW, 32, PropModeReplace, 
+    XChangeProperty(dpy, root, atoms[ATOM_NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32, PropModeReplace, 
                     (unsigned char *)&wm_window, 1);
-    XChangeProperty(dpy, wm_window, net_supporting_wm_check, XA_WINDOW, 32, PropModeReplace, 
+    XChangeProperty(dpy, wm_window, atoms[ATOM_NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32, PropModeReplace, 
                     (unsigned char *)&wm_window, 1);
 
     const char *wm_name = "rude";
-    Atom utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
-    XChangeProperty(dpy, wm_window, net_wm_name, utf8_string, 8, PropModeReplace, 
+    XChangeProperty(dpy, wm_window, atoms[ATOM_NET_WM_NAME], atoms[ATOM_UTF8_STRING], 8, PropModeReplace, 
                     (unsigned char *)wm_name, strlen(wm_name));
-    XChangeProperty(dpy, root, net_wm_name, utf8_string, 8, PropModeReplace, 
+    XChangeProperty(dpy, root, atoms[ATOM_NET_WM_NAME], atoms[ATOM_UTF8_STRING], 8, PropModeReplace, 
                     (unsigned char *)wm_name, strlen(wm_name));
 }
 
-void update_client_list(Window *clients, int nclients) {
-    Atom net_client_list = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
-    if (nclients > 0) {
-        XChangeProperty(dpy, root, net_client_list, XA_WINDOW, 32, PropModeReplace, (unsigned char *)clients, nclients);
+void update_client_list() {
+    static Window *windows = NULL;
+    static Window *published = NULL;
+    static int npublished = -1;
+    static int capacity = 0;
+    int n = 0;
+
+    for (int i = 0; i < NUM_DESKTOPS; i++)
+        n += desktops[i].nclients;
+    if (n > capacity) {
+        Window *new_windows = realloc(windows, sizeof(Window) * n * 2);
+        Window *new_published = realloc(published, sizeof(Window) * n * 2);
+        if (new_windows == NULL || new_published == NULL) {
+            fprintf(stderr, "rude: failed to allocate memory\n");
+            exit(1);
+        }
+        windows = new_windows;
+        published = new_published;
+        capacity = n * 2;
+    }
+    n = 0;
+    for (int i = 0; i < NUM_DESKTOPS; i++)
+        for (int j = 0; j < desktops[i].nclients; j++)
+            windows[n++] = desktops[i].clients[j]->window;
+
+    int common = 0;
+    while (common < npublished && common < n && windows[common] == published[common])
+        common++;
+
+    if (common == npublished && common == n) {
+        return;
+    } else if (n == 0) {
+        XDeleteProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST]);
+    } else if (common == npublished) {
+        XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST], XA_WINDOW, 32, PropModeAppend,
+                        (unsigned char *)&windows[common], n - common);
     } else {
-        XDeleteProperty(dpy, root, net_client_list);
+        XChangeProperty(dpy, root, atoms[ATOM_NET_CLIENT_LIST], XA_WINDOW, 32, PropModeReplace,
+                        (unsigned char *)windows, n);
     }
+    memcpy(published, windows, sizeof(Window) * n);
+    npublished = n;
 }
 
-void update_active_window(Window w) {
-    Atom net_active_window = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-    XChangeProperty(dpy, root, net_active_window, XA_WINDOW, 32, PropModeReplace, (unsigned char *)&w, 1);
+void update_active_window() {
+    static Window published = (Window)-1;
+    Window w = focused_window;
+
+    if (w == published)
+        return;
+    XChangeProperty(dpy, root, atoms[ATOM_NET_ACTIVE_WINDOW], XA_WINDOW, 32, PropModeReplace, (unsigned char *)&w, 1);
+    published = w;
 }
 
 void update_net_current_desktop() {
-    Atom net_current_desktop = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
-    XChangeProperty(dpy, root, net_current_desktop, XA_CARDINAL, 32, PropModeReplace,
-                    (unsigned char *)&current_desktop, 1);
+    static long published = -1;
+    long desktop = current_desktop;
+
+    if (desktop == published)
+        return;
+    XChangeProperty(dpy, root, atoms[ATOM_NET_CURRENT_DESKTOP], XA_CARDINAL, 32, PropModeReplace,
+                    (unsigned char *)&desktop, 1);
+    published = desktop;
 }
 
 void update_net_number_of_desktops() {
-    Atom net_number_of_desktops = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
     long num_desktops = NUM_DESKTOPS;
-    XChangeProperty(dpy, root, net_number_of_desktops, XA_CARDINAL, 32, PropModeReplace,
+    XChangeProperty(dpy, root, atoms[ATOM_NET_NUMBER_OF_DESKTOPS], XA_CARDINAL, 32, PropModeReplace,
                     (unsigned char *)&num_desktops, 1);
 }
 
-void update_net_desktop_for_window(Window w) {
-    Atom net_wm_desktop = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
-    XChangeProperty(dpy, w, net_wm_desktop, XA_CARDINAL, 32, PropModeReplace,
-                    (unsigned char *)&current_desktop, 1);
+void update_net_desktop_for_window(Window w, unsigned int desktop) {
+    long value = desktop;
+    XChangeProperty(dpy, w, atoms[ATOM_NET_WM_DESKTOP], XA_CARDINAL, 32, PropModeReplace,
+                    (unsigned char *)&value, 1);
 }
 
 int xerror(Display *dpy, XErrorEvent *ee) {
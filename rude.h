@@ -1,65 +1,450 @@
 #ifndef RUDE_H
 #define RUDE_H
 
+#define _GNU_SOURCE
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/keysym.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/sync.h>
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "layout.h"
 
 #define MODKEY Mod4Mask
 #define GAP 10
 #define NUM_DESKTOPS 5
+#define MAX_MONITORS 8
+#define STATE_VERSION 1
+#define TRACE_MAGIC "RUDETRC1"
+#define MASTER_RATIO 0.5
+#define MASTER_COUNT 1
+#define MOTION_RATE 0
+#define SYNC_TIMEOUT 100
+#define SYNC_TILE_WAIT 16
+#define CLIENT_SLAB 64
+#define FETCH_QUEUE_SIZE 256
+#define MAX_CONTROLS 8
+#define CONTROL_BUFSIZE 4096
+#define CLIENT_EVENT_MASK (StructureNotifyMask | EnterWindowMask | FocusChangeMask | PropertyChangeMask)
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#define LENGTH(X) (sizeof(X) / sizeof((X)[0]))
+#define CLEANMASK(mask) ((mask) & ~(numlockmask | LockMask) & \
+                         (ShiftMask | ControlMask | Mod1Mask | Mod2Mask | Mod3Mask | Mod4Mask | Mod5Mask))
+
+enum {
+    ATOM_WM_PROTOCOLS,
+    ATOM_WM_DELETE_WINDOW,
+    ATOM_UTF8_STRING,
+    ATOM_NET_SUPPORTED,
+    ATOM_NET_WM_STATE,
+    ATOM_NET_WM_STATE_FULLSCREEN,
+    ATOM_NET_ACTIVE_WINDOW,
+    ATOM_NET_WM_NAME,
+    ATOM_NET_SUPPORTING_WM_CHECK,
+    ATOM_NET_CLIENT_LIST,
+    ATOM_NET_CURRENT_DESKTOP,
+    ATOM_NET_NUMBER_OF_DESKTOPS,
+    ATOM_NET_WM_DESKTOP,
+    ATOM_NET_CLOSE_WINDOW,
+    ATOM_NET_WM_STRUT,
+    ATOM_NET_WM_STRUT_PARTIAL,
+    ATOM_NET_WM_WINDOW_TYPE,
+    ATOM_NET_WM_WINDOW_TYPE_DOCK,
+    ATOM_NET_WM_WINDOW_TYPE_DIALOG,
+    ATOM_NET_WM_WINDOW_TYPE_UTILITY,
+    ATOM_NET_WM_WINDOW_TYPE_SPLASH,
+    ATOM_NET_WM_WINDOW_TYPE_TOOLBAR,
+    ATOM_NET_WM_WINDOW_TYPE_NOTIFICATION,
+    ATOM_NET_WM_SYNC_REQUEST,
+    ATOM_NET_WM_SYNC_REQUEST_COUNTER,
+    ATOM_RUDE_STATE,
+    ATOM_RUDE_STATS,
+    ATOM_LAST
+};
+
+enum {
+    TIMER_DRAG,
+    TIMER_SYNC,
+    TIMER_LAST
+};
+
+enum {
+    CLIENT_HINTS = 1 << 0,
+    CLIENT_DELETE_WINDOW = 1 << 1,
+    CLIENT_FULLSCREEN = 1 << 2,
+    CLIENT_SYNC_REQUEST = 1 << 3,
+    CLIENT_SYNC_WAITING = 1 << 4,
+    CLIENT_SYNC_PENDING = 1 << 5,
+    CLIENT_FLOATING = 1 << 6
+};
+
+typedef union {
+    int i;
+    unsigned int ui;
+    float f;
+} Arg;
+
+typedef struct {
+    unsigned int mod;
+    KeySym keysym;
+    void (*func)(const Arg *);
+    const Arg arg;
+} Key;
+
+typedef struct {
+    const char *name;
+    Bool (*func)(int argc, char **argv);
+} Command;
+
+typedef struct {
+    int fd;
+    int len;
+    char buf[CONTROL_BUFSIZE];
+} ControlClient;
+
+typedef struct {
+    Bool valid;
+    Bool override_redirect;
+    int map_state;
+    WindowGeometry geom;
+    XSizeHints hints;
+    unsigned int flags;
+    Atom window_type;
+    Window transient_for;
+    XSyncCounter sync_counter;
+    unsigned long long sync_value;
+    Bool has_strut;
+    unsigned long strut[12];
+} WindowInfo;
+
+enum {
+    FETCH_MAP,
+    FETCH_HINTS,
+    FETCH_PROTOCOLS,
+    FETCH_COUNTER,
+    FETCH_STRUT
+};
+
+typedef struct {
+    Window window;
+    unsigned int kind;
+    unsigned long serial;
+    WindowInfo info;
+} Fetch;
+
+typedef struct {
+    Fetch items[FETCH_QUEUE_SIZE];
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+} FetchQueue;
+
+typedef struct {
+    Window window;
+    unsigned int kind;
+    unsigned long serial;
+} PendingFetch;
+
+typedef struct Client Client;
+struct Client {
+    Window window;
+    unsigned int desktop;
+    int index;
+    unsigned int flags;
+    WindowGeometry geom;
+    WindowGeometry applied;
+    unsigned long configure_serial;
+    XSizeHints hints;
+    Atom window_type;
+    Window transient_for;
+    XSyncCounter sync_counter;
+    XSyncAlarm sync_alarm;
+    unsigned long long sync_value;
+    long long sync_deadline;
+    WindowGeometry sync_geom;
+    Client *next_free;
+};
+
+typedef struct {
+    Client **clients;
+    int nclients;
+    int capacity;
+    Bool dirty;
+    unsigned int layout;
+    float master_ratio;
+    int master_count;
+    int monitor;
+} Desktop;
+
+enum {
+    TRACE_EVENT,
+    TRACE_CHECKED,
+    TRACE_FLUSH,
+    TRACE_TIMER,
+    TRACE_KEYCODE,
+    TRACE_CONTROL,
+    TRACE_ATOMS,
+    TRACE_TREE,
+    TRACE_STATE,
+    TRACE_FETCH
+};
+
+typedef struct {
+    char magic[8];
+    unsigned int width;
+    unsigned int height;
+    unsigned long long root;
+    unsigned int numlockmask;
+    unsigned int nkeys;
+} TraceHeader;
+
+typedef struct {
+    unsigned int kind;
+    unsigned int value;
+    unsigned long long time;
+} TraceRecord;
+
+typedef struct {
+    Window window;
+    WindowInfo info;
+} TraceFetch;
+
+#ifdef STATS
+#define HIST_BUCKETS 24
+#define STAT_INC(field) (stats.field++)
+#define STAT_ROUND_TRIP(display) ((display) == dpy ? stats.round_trips++ : 0)
+#define STAT_BEGIN(start) long long start = now_ns()
+#define STAT_END(hist, start) record_latency(&stats.hist, now_ns() - (start))
+
+enum {
+    STAT_TILE,
+    STAT_SWITCH,
+    STAT_FOCUS,
+    STAT_LAST
+};
+
+typedef struct {
+    unsigned long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long buckets[HIST_BUCKETS];
+} Histogram;
+
+typedef struct {
+    unsigned long round_trips;
+    unsigned long configures;
+    Histogram events[LASTEvent + 1];
+    Histogram funcs[STAT_LAST];
+} Stats;
+#else
+#define STAT_INC(field)
+#define STAT_ROUND_TRIP(display)
+#define STAT_BEGIN(start)
+#define STAT_END(hist, start)
+#endif
+
+typedef struct {
+    WindowGeometry geom;
+    WindowGeometry workarea;
+    unsigned int desktop;
+} Monitor;
 
 extern Display *dpy;
 extern Window root;
 extern int screen;
-extern Window *clients;
-extern int nclients;
+extern Desktop desktops[NUM_DESKTOPS];
 extern int current_client;
 extern unsigned int current_desktop;
-extern Window **desktop_clients;
-extern int *desktop_nclients;
+extern Bool client_list_dirty;
+extern Bool running;
+extern Bool restarting;
+extern const char *event_names[LASTEvent];
+#ifdef STATS
+extern Stats stats;
+#endif
 extern Bool is_floating_mode;
-extern XWindowAttributes wa;
+extern WindowGeometry drag_geom;
+extern unsigned int numlockmask;
+extern Window focused_window;
+extern Window top_window;
+extern unsigned long enter_serial;
+extern Bool have_sync;
+extern int sync_event_base;
 extern XButtonEvent start;
+extern unsigned int motion_interval;
+extern Time motion_time;
+extern Bool motion_pending;
+extern Atom atoms[ATOM_LAST];
 
 void setup(void);
 void run(void);
+void setup_loop(void);
+void cleanup(void);
+void handle_signals(void);
+void run_timers(void);
+void arm_timer(void);
+void schedule_timer(int timer, unsigned int ms);
+void cancel_timer(int timer);
+long long now_ms(void);
+void drag_timeout(void);
+void dump_state(void);
+void dispatch_event(XEvent *e);
+unsigned int flush_layout(void);
+void mark_layout_dirty(unsigned int desktop);
+void mark_all_layouts_dirty(void);
 void handle_keypress(XEvent *e);
+void handle_mappingnotify(XEvent *e);
+void update_numlockmask(void);
+void grab_keys(void);
+void grab_buttons(void);
+void ungrab_buttons(void);
+void kill_focused(const Arg *arg);
+void focus_next(const Arg *arg);
+void toggle_floating(const Arg *arg);
+void view_desktop(const Arg *arg);
+void set_layout(const Arg *arg);
+void adjust_master_ratio(const Arg *arg);
+void adjust_master_count(const Arg *arg);
+void setup_desktops(void);
 void handle_maprequest(XEvent *e);
 void handle_unmapnotify(XEvent *e);
 void handle_destroynotify(XEvent *e);
+void handle_mapnotify(XEvent *e);
+void handle_configurenotify(XEvent *e);
+void handle_propertynotify(XEvent *e);
 void handle_enternotify(XEvent *e);
+void handle_focus(XEvent *e);
 void handle_clientmessage(XEvent *e);
 void handle_buttonpress(XEvent *e);
 void handle_buttonrelease(XEvent *e);
 void handle_motionnotify(XEvent *e);
-void tile_windows(void);
-void add_client(Window w);
+void tile_windows(unsigned int desktop);
+void configure_client(Client *c, int x, int y, int width, int height);
+void set_fullscreen(Client *c, Bool fullscreen);
+void place_fullscreen(Client *c);
+Bool should_float(Client *c);
+void place_floating(Client *c);
+void setup_sync(void);
+void update_sync_counter(Client *c, XSyncCounter counter, unsigned long long value);
+void send_sync_request(Client *c);
+void finish_sync(Client *c);
+void handle_syncalarm(XEvent *e);
+void sync_timeout(void);
+void wait_for_sync(unsigned int retiled, unsigned int ms);
+XSyncCounter fetch_sync_counter(Display *display, Window w, unsigned long long *value);
+unsigned long long query_sync_value(Display *display, XSyncCounter counter);
+Client *add_client(Window w, WindowInfo *info, unsigned int desktop);
+void fetch_window_info(Display *display, Window w, WindowInfo *info);
+unsigned int fetch_protocols(Display *display, Window w);
+void manage_window(Window w, WindowInfo *info);
+void setup_fetcher(void);
+void stop_fetcher(void);
+void request_fetch(Window w, unsigned int kind);
+void run_fetch(Display *display, Fetch *f);
+void apply_fetch(Fetch *f);
+void drain_fetches(void);
+Bool fetch_pending(Window w, unsigned int kinds);
+void cancel_fetches(Window w, unsigned int kinds);
+Client *alloc_client(void);
+void free_client(Client *c);
 void remove_client(Window w);
+Client *find_client(Window w);
+void index_insert(Client *c);
+void index_remove(Window w);
 void kill_client(Window w);
 void focus_client(int index);
+void setup_atoms(void);
+void setup_motion_rate(void);
+void apply_drag(Client *c);
 void setup_ewmh(void);
-void update_client_list(Window *clients, int nclients);
-void update_active_window(Window w);
+void update_client_list(void);
+void update_active_window(void);
+void flush_ewmh(void);
 void switch_desktop(unsigned int desktop);
 void update_net_current_desktop(void);
 void update_net_number_of_desktops(void);
-void update_net_desktop_for_window(Window w);
+void update_net_desktop_for_window(Window w, unsigned int desktop);
 int xerror(Display *dpy, XErrorEvent *ee);
-void get_strut_partial(Window w, unsigned long *strut);
+Bool get_strut_partial(Display *display, Window w, unsigned long *strut);
+void adopt_windows(void);
+void save_state(void);
+#ifdef STATS
+void publish_stats(void);
+long long now_ns(void);
+void record_latency(Histogram *h, long long ns);
+void dump_stats(FILE *f, Bool json);
+#endif
+void setup_control(void);
+void handle_control(int fd);
+void close_control(ControlClient *cc);
+void run_commands(char *batch, FILE *reply);
+void write_state(FILE *f);
+Client *parse_client(const char *s);
+Bool parse_desktop(const char *s, unsigned int *desktop);
+Bool cmd_focus(int argc, char **argv);
+Bool cmd_kill(int argc, char **argv);
+Bool cmd_move(int argc, char **argv);
+Bool cmd_desktop(int argc, char **argv);
+Bool cmd_layout(int argc, char **argv);
+Bool cmd_float(int argc, char **argv);
+void move_client(Client *c, unsigned int desktop);
+void setup_trace(void);
+void trace_data(unsigned int kind, unsigned int value, const void *data, size_t size);
+void trace_record(unsigned int kind, unsigned int value, XEvent *ev);
+void trace_fetch(unsigned int kind, Window w, WindowInfo *info);
+Bool check_typed_event(int type, XEvent *ev);
+Bool check_next_event(int type, XEvent *ev);
+void fire_timer(int timer);
+void flush_pending(void);
+long *load_state(unsigned long *nitems);
+void restart(const Arg *arg);
+Bool set_strut(Window w, Bool has_strut, unsigned long *strut);
+Bool remove_strut(Window w);
+void update_workarea(void);
+void setup_monitors(void);
+void update_monitors(void);
+void handle_screenchange(XEvent *e);
+Monitor *desktop_monitor(unsigned int desktop);
+Bool desktop_visible(unsigned int desktop);
 
 typedef struct {
-    int x;
-    int y;
-    int width;
-    int height;
-} WindowGeometry;
+    Window window;
+    unsigned long strut[12];
+} Strut;
 
-extern WindowGeometry *window_geometries;
+extern Strut *struts;
+extern int nstruts;
+extern Bool struts_dirty;
+extern Monitor monitors[MAX_MONITORS];
+extern int nmonitors;
+extern Bool monitors_dirty;
+extern Bool have_randr;
+extern int randr_event_base;
 
 #endif // RUDE_H
\ No newline at end of file